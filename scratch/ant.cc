@@ -78,8 +78,16 @@ double traffic = 200;
 bool fullDuplex = false;
 bool collisionDetect = false;
 bool slotted = false;
+bool lazyEnergy = false;
 int nSensors = 2;
 double duration = 20;
+double gridRadius = 0;
+double aggregationDelay = 0;
+int echoSize = 1024;
+double warmup = 15;
+int convergeCycles = 10;
+std::string saveCheckpoint = "";
+std::string restoreCheckpoint = "";
 
 Ptr<OutputStreamWrapper> m_waterfall = 0;
 
@@ -161,6 +169,27 @@ ReportPSD (Ptr<const SpectrumValue> sv)
 	}
 }
 
+// start the measurement once the network is ready, and save its state for later runs
+void StartTraffic (Ptr<Node> client, Ipv6Address dst)
+{
+	std::cout << "% traffic starts at " << Simulator::Now ().GetSeconds () << " s" << std::endl;
+	if (saveCheckpoint != "")
+	{
+		FleeHelper flee;
+		flee.SaveCheckpoint (NodeContainer::GetGlobal (), saveCheckpoint);
+	}
+
+	UdpEchoClientHelper echoClient (dst, 9);
+	echoClient.SetAttribute ("MaxPackets", UintegerValue (1));
+	echoClient.SetAttribute ("Interval", TimeValue (Seconds (1.0)));
+	echoClient.SetAttribute ("PacketSize", UintegerValue (echoSize));
+
+	ApplicationContainer clientApps = echoClient.Install (client);
+	clientApps.Start (Seconds (0.0));
+	clientApps.Stop (Seconds (3.0));
+	Simulator::Stop (Seconds (5.0));
+}
+
 // The main function implementation
 int mainBody (int argc, char **argv)
 {
@@ -193,20 +222,27 @@ int mainBody (int argc, char **argv)
 	LrWpanHelper lrWpanHelper (true);
 	
 	//Create Channel
-	Ptr<SpectrumChannel> channel = CreateObject<MultiModelSpectrumChannel>();
-	Ptr<PropagationLossModel> lossModel = CreateObject<LogDistancePropagationLossModel> ();
-	Ptr<PropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
-	channel->AddPropagationLossModel (lossModel);
-	channel->SetPropagationDelayModel (delayModel);
-	lrWpanHelper.SetChannel (channel);
+	if (gridRadius > 0)
+	{
+		// only deliver signals to nodes closer than gridRadius
+		lrWpanHelper.EnableSpatialGrid (gridRadius);
+	}
+	else
+	{
+		Ptr<SpectrumChannel> channel = CreateObject<MultiModelSpectrumChannel>();
+		Ptr<PropagationLossModel> lossModel = CreateObject<LogDistancePropagationLossModel> ();
+		Ptr<PropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
+		channel->AddPropagationLossModel (lossModel);
+		channel->SetPropagationDelayModel (delayModel);
+		lrWpanHelper.SetChannel (channel);
+	}
 
 	// Install stack (2)
 	NetDeviceContainer netdev = lrWpanHelper.InstallFlee (lrwpanNodes); // uses Friss propagation
 
 	// Finish the nodes : fd-hd, (un)slotted CSMA,...
-	for (int inode = 0; inode<1+nSensors; inode++){
-		netdev.Get(inode)->GetObject<LrWpanNetDevice> ()->GetMac()->GetCsmaCa()->AssignStreams(inode);
-	}
+	// pin the CSMA, PHY and FLEE MAC random streams
+	int64_t streams = lrWpanHelper.AssignStreams (netdev, 0);
 	for(int inode=0; inode<1+nSensors;inode++){
 		netdev.Get(inode)->GetObject<LrWpanNetDevice> ()->GetMac()->SetFullDuplex(fullDuplex);
 		netdev.Get(inode)->GetObject<LrWpanNetDevice> ()->GetMac()->SetCollisionDetect(collisionDetect);
@@ -249,14 +285,27 @@ int mainBody (int argc, char **argv)
 	netdev.Get(0)->GetObject<LrWpanNetDevice>()->GetMac()->TraceConnectWithoutContext("MacTxOk", MakeCallback(&receivedGw));
 
 	/* energy source */
-	LrWpanEnergySourceHelper LrWpanEnergySourceHelper;
-	// configure energy source
-	LrWpanEnergySourceHelper.Set ("LrWpanEnergySourceInitialEnergyJ", DoubleValue (10));
-	LrWpanEnergySourceHelper.Set ("LrWpanUnlimitedEnergy",BooleanValue(false));
-	LrWpanEnergySourceHelper.Set ("LrWpanEnergySupplyVoltageV", DoubleValue(2));
-	LrWpanEnergySourceHelper.Set ("PeriodicEnergyUpdateInterval", TimeValue(Seconds(0.4)));
-	// install source
-	EnergySourceContainer energySources = LrWpanEnergySourceHelper.Install (lrwpanNodes);
+	EnergySourceContainer energySources;
+	if (lazyEnergy)
+	{
+		// only integrates the current at state changes of the radio, no periodic events
+		LrWpanLazyEnergySourceHelper lazyEnergySourceHelper;
+		lazyEnergySourceHelper.Set ("LrWpanEnergySourceInitialEnergyJ", DoubleValue (10));
+		lazyEnergySourceHelper.Set ("LrWpanUnlimitedEnergy",BooleanValue(false));
+		lazyEnergySourceHelper.Set ("LrWpanEnergySupplyVoltageV", DoubleValue(2));
+		energySources = lazyEnergySourceHelper.Install (lrwpanNodes);
+	}
+	else
+	{
+		LrWpanEnergySourceHelper LrWpanEnergySourceHelper;
+		// configure energy source
+		LrWpanEnergySourceHelper.Set ("LrWpanEnergySourceInitialEnergyJ", DoubleValue (10));
+		LrWpanEnergySourceHelper.Set ("LrWpanUnlimitedEnergy",BooleanValue(false));
+		LrWpanEnergySourceHelper.Set ("LrWpanEnergySupplyVoltageV", DoubleValue(2));
+		LrWpanEnergySourceHelper.Set ("PeriodicEnergyUpdateInterval", TimeValue(Seconds(0.4)));
+		// install source
+		energySources = LrWpanEnergySourceHelper.Install (lrwpanNodes);
+	}
 	/* device energy model */
 	LrWpanRadioEnergyModelHelper radioEnergyHelper;
 	// configure radio energy model
@@ -276,9 +325,17 @@ int mainBody (int argc, char **argv)
 	FleeHelper flee;
 	internet.SetRoutingHelper (flee);
 	internet.InstallFlee (lrwpanNodes);
+	// and the routing randomness after the MAC streams
+	flee.AssignStreams (lrwpanNodes, streams);
 
 	pan.Get(0)->GetObject<Ipv6> ()->GetRoutingProtocol ()->SetAttribute("Sink",UintegerValue (0));
 
+	// skip the warm-up with the state of an earlier run
+	if (restoreCheckpoint != "")
+	{
+		flee.RestoreCheckpoint (lrwpanNodes, restoreCheckpoint);
+	}
+
 	Ipv6AddressHelper ad;
   Ipv6InterfaceContainer interfaces = ad.Assign(dev2);
 
@@ -286,26 +343,31 @@ int mainBody (int argc, char **argv)
 
   ApplicationContainer serverApps = echoServer.Install (pan.Get (1));
   serverApps.Start (Seconds (1.0));
-  serverApps.Stop (Seconds (20.0));
+  serverApps.Stop (Seconds (duration));
 
-  UdpEchoClientHelper echoClient (interfaces.GetAddress (1,1), 9);
-  echoClient.SetAttribute ("MaxPackets", UintegerValue (1));
-  echoClient.SetAttribute ("Interval", TimeValue (Seconds (1.0)));
-  echoClient.SetAttribute ("PacketSize", UintegerValue (1024));
-
-  ApplicationContainer clientApps = echoClient.Install (sensors.Get (0));
-  clientApps.Start (Seconds (15.0));
-  clientApps.Stop (Seconds (18.0));
+	// the duration is the upper bound, the run ends 5 s after the traffic starts
+	FleeConvergenceMonitor monitor;
+	if (convergeCycles > 0)
+	{
+		monitor.SetStableCycles (convergeCycles);
+		monitor.Start (lrwpanNodes, MakeBoundCallback (&StartTraffic, sensors.Get (0), interfaces.GetAddress (1,1)));
+	}
+	else
+	{
+		Simulator::Schedule (Seconds (warmup), &StartTraffic, sensors.Get (0), interfaces.GetAddress (1,1));
+	}
 
 	//Start de simulator
 	Simulator::Run ();
-	Simulator::Destroy ();
+	if (convergeCycles > 0 && !monitor.IsConverged ())
+		std::cout << "% not converged within " << duration << " s" << std::endl;
 	double remainingEnergy =0.0;
 
-	// Calculate remaining energy
+	// Calculate remaining energy, before the clock is reset by Destroy
 	for(int i =1; i<=nSensors; i++){
 		remainingEnergy += 10-energySources.Get(i)->GetRemainingEnergy();
 	}
+	Simulator::Destroy ();
 	// Print results
 	if (true)
 	{
@@ -334,8 +396,23 @@ int main (int argc, char **argv){
 	cmd.AddValue ("collisionDetect","set in collision detection mode",collisionDetect);
 	cmd.AddValue ("slotted","set the csma-ca protocol in slotted mode",slotted);
 	cmd.AddValue ("nSensors","number of extra sensors",nSensors);
+	cmd.AddValue ("lazyEnergy","only update the energy sources at radio state changes instead of every 0.4 s",lazyEnergy);
+	cmd.AddValue ("gridRadius","cutoff radius of the spatial grid channel in m (0 disables it)",gridRadius);
+
+	cmd.AddValue ("aggregationDelay","time in ms a relay holds UDP readings to merge them (0 disables it)",aggregationDelay);
+	cmd.AddValue ("echoSize","size of the echo packets in bytes, readings above 74 bytes are never aggregated",echoSize);
+
+	cmd.AddValue ("convergeCycles","start the traffic after the network is stable for this many cycles (0 waits for the fixed warm-up)",convergeCycles);
+	cmd.AddValue ("saveCheckpoint","file to save the FLEE state to when the traffic starts",saveCheckpoint);
+	cmd.AddValue ("restoreCheckpoint","file to restore the FLEE state from instead of the warm-up",restoreCheckpoint);
 
 	cmd.Parse (argc,argv);
+	if (restoreCheckpoint != "" && convergeCycles == 0)
+	{
+		duration -= warmup;
+		warmup = 0;
+	}
+	Config::SetDefault ("ns3::FleeRouting::AggregationDelay", TimeValue (MilliSeconds (aggregationDelay)));
 
 	mainBody(argc, argv);
 }
@@ -0,0 +1,335 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ *
+ *
+ */
+
+// Micro-benchmarks of the FLEE hot paths: the routing table lookup and the
+// slot scheduler, neighbour table and reception path of the FLEE MAC.  Every
+// function is driven with synthetic tables of 1 up to 10000 entries, and the
+// cost is reported as ns/op, allocations/op and the peak RSS.  Every
+// benchmark runs in its own process, so the peak RSS is the one of that
+// benchmark alone.  The MAC cycle is stopped and the events the operations
+// schedule are run between the timed chunks, so the event queue does not grow
+// with the number of operations.
+//
+// ./waf --run "flee-bench --maxEntries=10000 --minTime=0.2"
+
+#include "ns3/log.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/lr-wpan-module.h"
+#include <ns3/flee-module.h>
+#include <ns3/sixlowpan-module.h>
+#include <ns3/lr-wpan-flee-mac-test-access.h>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("FleeBench");
+
+// every allocation of the process is counted
+static uint64_t g_allocations = 0;
+
+void *
+operator new (std::size_t size)
+{
+	g_allocations++;
+	void *p = std::malloc (size ? size : 1);
+	if (!p)
+		throw std::bad_alloc ();
+	return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+	std::free (p);
+}
+
+void *
+operator new[] (std::size_t size)
+{
+	return operator new (size);
+}
+
+void
+operator delete[] (void *p) noexcept
+{
+	operator delete (p);
+}
+
+// Simulation parameters
+uint32_t maxEntries = 10000;
+double minTime = 0.2;
+
+// peak resident set size in kB
+static long
+PeakRss (void)
+{
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static void
+Report (std::string name, uint32_t entries, double seconds, uint64_t ops, uint64_t allocations)
+{
+	std::cout << std::setiosflags (std::ios::left) << std::setw (22) << name
+		<< std::resetiosflags (std::ios::left)
+		<< std::setw (8) << entries
+		<< std::setw (14) << std::fixed << std::setprecision (1) << seconds * 1e9 / ops
+		<< std::setw (12) << std::setprecision (2) << (double)allocations / ops
+		<< std::setw (10) << PeakRss () << std::endl;
+}
+
+static void
+IgnoreIndication (McpsDataIndicationParams params, Ptr<Packet> p)
+{
+}
+
+// one node with the full FLEE stack, its slot scheduler is driven through LrWpanFleeMacTestAccess
+class FleeBenchmark
+{
+public:
+	// one node with the full FLEE stack
+	FleeBenchmark (void);
+	// add n neighbours to the table of the MAC
+	void AddNeighbours (uint32_t n);
+	// add n host routes to the routing table
+	void AddRoutes (uint32_t n);
+
+	// run op repeatedly for at least minTime and report it, the events it
+	// scheduled are run after every chunk of ops, outside of the timing
+	template <class F>
+	void Measure (std::string name, uint32_t entries, uint64_t chunk, F op);
+
+	void BenchLookupStatic (uint32_t entries);
+	void BenchScheduleSlots (uint32_t entries);
+	void BenchScheduleSlot (uint32_t entries);
+	void BenchMcpsDataIndication (uint32_t entries);
+
+private:
+	// address of the i-th synthetic neighbour
+	static Mac16Address GetNeighbour (uint32_t i);
+	// global address of the i-th synthetic destination
+	static Ipv6Address GetDestination (uint32_t i);
+
+	NodeContainer m_nodes;
+	Ptr<LrWpanFleeMac> m_mac;
+	Ptr<FleeRouting> m_routing;
+	uint32_t m_neighbours;
+	uint32_t m_routes;
+};
+
+FleeBenchmark::FleeBenchmark (void)
+	: m_neighbours (0),
+	m_routes (0)
+{
+	m_nodes.Create (1);
+	LrWpanHelper lrWpanHelper (true);
+	NetDeviceContainer netdev = lrWpanHelper.InstallFlee (m_nodes);
+	Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+	netdev.Get(0)->GetObject<LrWpanNetDevice> ()->GetPhy ()->SetMobility (mobility);
+	lrWpanHelper.AssociateToPan(netdev,0);
+
+	SixLowPanHelper sixHelper;
+	NetDeviceContainer dev2 = sixHelper.Install (netdev);
+	InternetStackHelper internet;
+	internet.SetIpv4StackInstall (false);
+	FleeHelper flee;
+	internet.SetRoutingHelper (flee);
+	internet.InstallFlee (m_nodes);
+	Ipv6AddressHelper ad;
+	ad.Assign(dev2);
+
+	m_nodes.Get(0)->Initialize ();
+	m_mac = DynamicCast<LrWpanFleeMac> (netdev.Get(0)->GetObject<LrWpanNetDevice> ()->GetMac ());
+	m_mac->SetMcpsDataIndicationCallback (MakeCallback (&IgnoreIndication));
+	m_routing = DynamicCast<FleeRouting> (flee.GetRouting (m_nodes.Get(0)->GetObject<Ipv6> ()));
+	// only the benchmarks schedule slots, and the setup events are done before measuring
+	LrWpanFleeMacTestAccess::StopCycle (m_mac);
+	Simulator::Run ();
+}
+
+Mac16Address
+FleeBenchmark::GetNeighbour (uint32_t i)
+{
+	uint8_t buf[2];
+	buf[0] = ((i + 2) >> 8) & 0xff;
+	buf[1] = (i + 2) & 0xff;
+	Mac16Address address;
+	address.CopyFrom (buf);
+	return address;
+}
+
+Ipv6Address
+FleeBenchmark::GetDestination (uint32_t i)
+{
+	uint8_t buf[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+	buf[12] = (i >> 24) & 0xff;
+	buf[13] = (i >> 16) & 0xff;
+	buf[14] = (i >> 8) & 0xff;
+	buf[15] = i & 0xff;
+	return Ipv6Address (buf);
+}
+
+void
+FleeBenchmark::AddNeighbours (uint32_t n)
+{
+	for (; m_neighbours < n; m_neighbours++){
+		McpsDataIndicationParams params;
+		params.m_srcAddrMode = SHORT_ADDR;
+		params.m_srcAddr = GetNeighbour (m_neighbours);
+		params.m_dstAddrMode = SHORT_ADDR;
+		params.m_dstAddr = m_mac->GetShortAddress ();
+		LrWpanFleeMacTestAccess::SetLatestStart (m_mac, MilliSeconds (m_neighbours % 100));
+		LrWpanFleeMacTestAccess::McpsDataIndication (m_mac, params, Create<Packet> (10));
+	}
+}
+
+void
+FleeBenchmark::AddRoutes (uint32_t n)
+{
+	for (; m_routes < n; m_routes++)
+		m_routing->AddHostRouteTo (GetDestination (m_routes), Ipv6Address ("fe80::ff:fe00:2"), 1);
+}
+
+template <class F>
+void
+FleeBenchmark::Measure (std::string name, uint32_t entries, uint64_t chunk, F op)
+{
+	uint64_t ops = 0;
+	uint64_t allocations = 0;
+	double elapsed = 0;
+	for (uint64_t batch = 1; elapsed < minTime; batch *= 2){
+		for (uint64_t done = 0; done < batch; ){
+			uint64_t n = std::min (chunk, batch - done);
+			uint64_t before = g_allocations;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+			for (uint64_t i = 0; i < n; i++)
+				op (ops + done + i);
+			elapsed += std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+			allocations += g_allocations - before;
+			done += n;
+			// the MAC cycle is stopped, so this only runs what the ops scheduled
+			Simulator::Run ();
+		}
+		ops += batch;
+	}
+	Report (name, entries, elapsed, ops, allocations);
+}
+
+void
+FleeBenchmark::BenchLookupStatic (uint32_t entries)
+{
+	AddRoutes (entries);
+	Ipv6Header header;
+	header.SetSourceAddress (GetDestination (0));
+	Ptr<Packet> p = Create<Packet> (10);
+	Socket::SocketErrno err;
+	// LookupStatic is only reachable through the public RouteOutput
+	Measure ("LookupStatic", entries, 1024, [&] (uint64_t i) {
+		header.SetDestinationAddress (GetDestination (i % entries));
+		m_routing->RouteOutput (p, header, 0, err);
+	});
+}
+
+void
+FleeBenchmark::BenchScheduleSlots (uint32_t entries)
+{
+	AddNeighbours (entries);
+	// every call schedules a slot per neighbour
+	Measure ("ScheduleSlots", entries, 1, [&] (uint64_t i) {
+		LrWpanFleeMacTestAccess::ScheduleSlots (m_mac);
+	});
+}
+
+void
+FleeBenchmark::BenchScheduleSlot (uint32_t entries)
+{
+	AddNeighbours (entries);
+	// every call runs the whole slot of a link, alternating its RX and idle TX turns
+	Measure ("ScheduleSlot", entries, 1024, [&] (uint64_t i) {
+		LrWpanFleeMacTestAccess::ScheduleSlot (m_mac, GetNeighbour (i % entries));
+	});
+}
+
+void
+FleeBenchmark::BenchMcpsDataIndication (uint32_t entries)
+{
+	AddNeighbours (entries);
+	McpsDataIndicationParams params;
+	params.m_srcAddrMode = SHORT_ADDR;
+	params.m_dstAddrMode = SHORT_ADDR;
+	params.m_dstAddr = m_mac->GetShortAddress ();
+	Ptr<Packet> p = Create<Packet> (10);
+	Measure ("McpsDataIndication", entries, 1024, [&] (uint64_t i) {
+		params.m_srcAddr = GetNeighbour (i % entries);
+		LrWpanFleeMacTestAccess::McpsDataIndication (m_mac, params, p);
+	});
+}
+
+// the benchmarks to run, with their table size
+std::vector<std::pair<void (FleeBenchmark::*) (uint32_t), uint32_t> > benchmarks;
+
+// run one benchmark on a fresh node, in a child process of its own
+static void
+RunBench (uint32_t index)
+{
+	{
+		FleeBenchmark benchmark;
+		(benchmark.*benchmarks[index].first) (benchmarks[index].second);
+	}
+	Simulator::Destroy ();
+}
+
+// main function
+int main (int argc, char **argv){
+	// read input parameters, this is easier for starting scripts.
+	CommandLine cmd;
+	cmd.AddValue ("maxEntries","largest table or neighbour set to benchmark",maxEntries);
+	cmd.AddValue ("minTime","minimum measuring time per benchmark in s",minTime);
+	cmd.Parse (argc,argv);
+
+	std::cout << std::setiosflags (std::ios::left) << std::setw (22) << "% benchmark"
+		<< std::resetiosflags (std::ios::left)
+		<< std::setw (8) << "entries" << std::setw (14) << "ns/op" << std::setw (12) << "allocs/op"
+		<< std::setw (10) << "rss[kB]" << std::endl;
+
+	for (uint32_t entries = 1; entries <= maxEntries; entries *= 10){
+		benchmarks.push_back (std::make_pair (&FleeBenchmark::BenchLookupStatic, entries));
+		benchmarks.push_back (std::make_pair (&FleeBenchmark::BenchScheduleSlots, entries));
+		benchmarks.push_back (std::make_pair (&FleeBenchmark::BenchScheduleSlot, entries));
+		benchmarks.push_back (std::make_pair (&FleeBenchmark::BenchMcpsDataIndication, entries));
+	}
+	// one at a time, so they do not disturb each other's timing
+	uint32_t failed = FleePartitionHelper::RunPartitions (benchmarks.size (), MakeCallback (&RunBench), 1);
+	return failed == 0 ? 0 : 1;
+}
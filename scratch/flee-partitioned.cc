@@ -0,0 +1,217 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ *
+ *
+ */
+
+// Many FLEE trees, each with its own sink, spread over a square grid.  The
+// trees are split in partitions that do not hear each other, and every
+// partition is simulated in its own process.  The partitions do not
+// synchronise, so trees within radio range of each other share a partition.
+// Every partition reports to the parent, which prints one line per
+// partition and the totals of the deployment.
+
+#include "ns3/log.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/lr-wpan-module.h"
+#include <ns3/flee-module.h>
+#include <ns3/sixlowpan-module.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <math.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("FleePartitioned");
+
+// Simulation parameters
+int nTrees = 4;
+int nSensors = 10;
+double treeSpacing = 500;
+double gridRadius = 100;
+int partitions = 0;
+double duration = 20;
+
+// position and role of every node of the deployment
+std::vector<Vector> positions;
+std::vector<bool> isSink;
+std::vector<uint32_t> partitionOf;
+// every child writes the result of its partition as one line to the parent
+int results[2];
+
+// place the trees on a square grid, with the sensors on a spiral around the sink
+void
+CreateDeployment (void)
+{
+	int side = ceil(sqrt((double)nTrees));
+	for (int tree = 0; tree < nTrees; tree++){
+		double cx = (tree % side) * treeSpacing;
+		double cy = (tree / side) * treeSpacing;
+		positions.push_back (Vector (cx, cy, 0));
+		isSink.push_back (true);
+		for (int inode = 0; inode < nSensors; inode++){
+			positions.push_back (Vector (cx+cos(((double)inode)/((double)nSensors)*2*3.14)*inode,cy+sin(((double)inode)/((double)nSensors)*2*3.14)*inode,0));
+			isSink.push_back (false);
+		}
+	}
+}
+
+// simulate the nodes of one partition, runs in a child process
+void
+RunPartition (uint32_t partition)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+	std::vector<uint32_t> members;
+	for (uint32_t i = 0; i < positions.size (); i++)
+		if (partitionOf[i] == partition)
+			members.push_back (i);
+	if (members.empty ())
+		return;
+
+	NodeContainer nodes;
+	nodes.Create (members.size ());
+
+	// the grid channel never delivers signals across partitions either
+	LrWpanHelper lrWpanHelper (true);
+	lrWpanHelper.EnableSpatialGrid (gridRadius);
+	NetDeviceContainer netdev = lrWpanHelper.InstallFlee (nodes);
+
+	uint32_t sinks = 0;
+	for (uint32_t i = 0; i < members.size (); i++){
+		Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+		mobility->SetPosition (positions[members[i]]);
+		netdev.Get(i)->GetObject<LrWpanNetDevice> ()->GetPhy ()->SetMobility (mobility);
+	}
+	lrWpanHelper.AssociateToPan(netdev,0);
+	int64_t streams = lrWpanHelper.AssignStreams (netdev, 0);
+
+	SixLowPanHelper sixHelper;
+	NetDeviceContainer dev2 = sixHelper.Install (netdev);
+
+	InternetStackHelper internet;
+	internet.SetIpv4StackInstall (false);
+	FleeHelper flee;
+	internet.SetRoutingHelper (flee);
+	internet.InstallFlee (nodes);
+	flee.AssignStreams (nodes, streams);
+
+	for (uint32_t i = 0; i < members.size (); i++)
+		if (isSink[members[i]]){
+			nodes.Get(i)->GetObject<Ipv6> ()->GetRoutingProtocol ()->SetAttribute("Sink",UintegerValue (0));
+			sinks++;
+		}
+
+	Ipv6AddressHelper ad;
+	ad.Assign(dev2);
+
+	Simulator::Stop(Seconds(duration));
+	uint64_t executed = Simulator::GetEventCount ();
+	Simulator::Run ();
+	uint64_t events = Simulator::GetEventCount () - executed;
+	// the sensors that found a path to a sink
+	uint32_t routed = 0;
+	for (uint32_t i = 0; i < members.size (); i++)
+		if (!isSink[members[i]] && !DynamicCast<FleeRouting> (flee.GetRouting (nodes.Get(i)->GetObject<Ipv6> ()))->GetParents ().empty ())
+			routed++;
+	Simulator::Destroy ();
+
+	double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	std::ostringstream result;
+	result << partition << " " << members.size () << " " << sinks << " " << routed << " " << events << " " << wall << "\n";
+	// a single short write, so the line of a partition is never split
+	std::string line = result.str ();
+	if (write (results[1], line.data (), line.size ()) != (ssize_t) line.size ())
+		NS_FATAL_ERROR ("Could not write the result of partition " << partition);
+}
+
+// main function
+int main (int argc, char **argv){
+	// read input parameters, this is easier for starting scripts.
+	CommandLine cmd;
+	cmd.AddValue ("nTrees","number of FLEE trees, each with its own sink",nTrees);
+	cmd.AddValue ("nSensors","number of sensors per tree",nSensors);
+	cmd.AddValue ("treeSpacing","distance between the sinks in m",treeSpacing);
+	cmd.AddValue ("gridRadius","radio range in m, nodes closer than this share a partition",gridRadius);
+	cmd.AddValue ("partitions","number of processes to simulate in (0 uses every core)",partitions);
+	cmd.AddValue ("duration","simulated time in s",duration);
+	cmd.Parse (argc,argv);
+
+	if (partitions <= 0)
+		partitions = sysconf (_SC_NPROCESSORS_ONLN);
+
+	CreateDeployment ();
+
+	FleePartitionHelper partitionHelper;
+	partitionHelper.SetCutoffRadius (gridRadius);
+	partitionOf = partitionHelper.Partition (positions, partitions);
+
+	std::cout << "% " << positions.size () << " nodes in " << partitionHelper.GetNClusters () << " clusters over "
+		<< partitions << " partitions" << std::endl;
+
+	if (pipe (results) != 0)
+		NS_FATAL_ERROR ("Could not create the result pipe");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+	uint32_t failed = FleePartitionHelper::RunPartitions (partitions, MakeCallback (&RunPartition));
+	double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	close (results[1]);
+	std::string lines;
+	char buf[4096];
+	ssize_t n;
+	while ((n = read (results[0], buf, sizeof (buf))) > 0)
+		lines.append (buf, n);
+	close (results[0]);
+
+	// one line per partition that finished, then the sum over them
+	uint32_t totalNodes = 0, totalSinks = 0, totalRouted = 0, finished = 0;
+	uint64_t totalEvents = 0;
+	double cpu = 0;
+	std::istringstream list (lines);
+	std::string line;
+	std::cout << "% partition nodes sinks routed events wall[s]" << std::endl;
+	while (std::getline (list, line)){
+		uint32_t partition, nodes, sinks, routed;
+		uint64_t events;
+		double partitionWall;
+		std::istringstream fields (line);
+		if (!(fields >> partition >> nodes >> sinks >> routed >> events >> partitionWall))
+			continue;
+		std::cout << partition << " " << nodes << " " << sinks << " " << routed << " " << events << " " << partitionWall << std::endl;
+		totalNodes += nodes;
+		totalSinks += sinks;
+		totalRouted += routed;
+		totalEvents += events;
+		cpu += partitionWall;
+		finished++;
+	}
+	std::cout << "% total over " << finished << " partitions: " << totalNodes << " nodes, " << totalSinks << " sinks, "
+		<< totalRouted << " routed sensors, " << totalEvents << " events, " << wall << " s wall, "
+		<< cpu << " s summed over the partitions" << std::endl;
+	if (failed > 0)
+		std::cout << "% " << failed << " partitions failed" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 NXP
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ *
+ *
+ */
+
+// Scaling benchmark of a single FLEE tree.  The sensors are placed on a
+// square grid around the sink and every sensor sends the same traffic.  For
+// every network size, the simulation runs in its own process and prints a
+// JSON object with the simulated seconds per wall second, the events per
+// wall second, the peak memory and the time the FLEE tree needed to become
+// stable with a parent for every node.
+//
+// ./waf --run "flee-scaling --sizes=10,100,1000,10000" > scaling.json
+
+#include "ns3/log.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/lr-wpan-module.h"
+#include <ns3/flee-module.h>
+#include <ns3/sixlowpan-module.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <math.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("FleeScaling");
+
+// Simulation parameters
+std::string sizes = "10,100,1000,10000";
+double duration = 30;
+double spacing = 20;
+double gridRadius = 100;
+double trafficStart = 10;
+double trafficInterval = 10;
+int pktSize = 20;
+int sinkRadios = 1;
+std::string replayTrace = "";
+std::string snapshotPrefix = "";
+double snapshotInterval = 0;
+bool latencyStats = false;
+double registrationInterval = 0;
+
+std::vector<uint32_t> nodeCounts;
+// every child writes the JSON object of its size as one line to the parent
+int results[2];
+
+// the convergence time is read from the monitor after the run
+void
+Converged (void)
+{
+	NS_LOG_INFO ("Converged at " << Simulator::Now ().GetSeconds () << " s");
+}
+
+// percentiles of a latency histogram as a JSON object, in ms
+void
+WriteLatency (std::ostream &os, const LrWpanFleeLatencyHistogram &histogram)
+{
+	os << "{\"count\":" << histogram.GetCount ()
+		<< ",\"p50\":" << histogram.GetPercentile (0.5).GetSeconds () * 1000
+		<< ",\"p99\":" << histogram.GetPercentile (0.99).GetSeconds () * 1000
+		<< ",\"p999\":" << histogram.GetPercentile (0.999).GetSeconds () * 1000 << "}";
+}
+
+// simulate one network size, runs in a child process
+void
+RunSize (uint32_t index)
+{
+	uint32_t nNodes = nodeCounts[index];
+
+	NodeContainer nodes;
+	nodes.Create (nNodes);
+
+	LrWpanHelper lrWpanHelper (true);
+	lrWpanHelper.EnableSpatialGrid (gridRadius);
+	// the first devices are the radios of the sink
+	NetDeviceContainer netdev = lrWpanHelper.InstallFleeSink (nodes.Get (0), sinkRadios);
+	for (uint32_t i = 1; i < nNodes; i++)
+		netdev.Add (lrWpanHelper.InstallFlee (nodes.Get (i)));
+
+	// node 0 is the sink in the middle of a square grid
+	int side = ceil (sqrt ((double)nNodes));
+	int center = (side/2) * side + side/2;
+	for (uint32_t d = 0; d < netdev.GetN (); d++){
+		uint32_t i = (d < (uint32_t)sinkRadios) ? 0 : d - sinkRadios + 1;
+		// the sink takes the center cell, the sensors fill up the others
+		int cell = (i == 0) ? center : ((int)i <= center ? (int)i - 1 : (int)i);
+		Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+		mobility->SetPosition (Vector ((cell % side - side/2) * spacing, (cell / side - side/2) * spacing, 0));
+		netdev.Get(d)->GetObject<LrWpanNetDevice> ()->GetPhy ()->SetMobility (mobility);
+	}
+	lrWpanHelper.AssociateToPan(netdev,0);
+	int64_t streams = lrWpanHelper.AssignStreams (netdev, 0);
+
+	SixLowPanHelper sixHelper;
+	NetDeviceContainer dev2 = sixHelper.Install (netdev);
+
+	InternetStackHelper internet;
+	internet.SetIpv4StackInstall (false);
+	FleeHelper flee;
+	internet.SetRoutingHelper (flee);
+	internet.InstallFlee (nodes);
+	flee.AssignStreams (nodes, streams);
+
+	nodes.Get(0)->GetObject<Ipv6> ()->GetRoutingProtocol ()->SetAttribute("Sink",UintegerValue (0));
+
+	Ipv6AddressHelper ad;
+	Ipv6InterfaceContainer interfaces = ad.Assign(dev2);
+
+	Ptr<FleeRouting> sinkRouting = DynamicCast<FleeRouting> (flee.GetRouting (nodes.Get(0)->GetObject<Ipv6> ()));
+	// every node has a parent and no distance or neighbour table changed for 10 cycles
+	FleeConvergenceMonitor monitor;
+	monitor.Start (nodes, MakeCallback (&Converged));
+
+	// every sensor offers the same load to the sink
+	UdpServerHelper server (9);
+	ApplicationContainer serverApps = server.Install (nodes.Get (0));
+	serverApps.Start (Seconds (0));
+
+	// or replays a recorded trace, whose time 0 is trafficStart
+	FleeTraceReplay replay;
+	if (replayTrace != "")
+	{
+		replay.Open (replayTrace);
+		Simulator::Schedule (Seconds (trafficStart), &FleeTraceReplay::Start, &replay, Seconds (trafficStart));
+	}
+	else
+	{
+		UdpClientHelper client (interfaces.GetAddress (0,1), 9);
+		client.SetAttribute ("MaxPackets", UintegerValue ((uint32_t)(duration / trafficInterval) + 1));
+		client.SetAttribute ("Interval", TimeValue (Seconds (trafficInterval)));
+		client.SetAttribute ("PacketSize", UintegerValue (pktSize));
+		ApplicationContainer clientApps;
+		for (uint32_t i = 1; i < nNodes; i++)
+			clientApps.Add (client.Install (nodes.Get (i)));
+		clientApps.Start (Seconds (trafficStart));
+	}
+
+	// routing tables as NDJSON, one file per size
+	Ptr<OutputStreamWrapper> snapshots;
+	if (snapshotPrefix != "")
+	{
+		std::ostringstream name;
+		name << snapshotPrefix << "-" << nNodes << ".ndjson";
+		snapshots = Create<OutputStreamWrapper> (name.str (), std::ios::out);
+		if (snapshotInterval > 0)
+			flee.WriteSnapshotEvery (Seconds (snapshotInterval), nodes, snapshots, FleeRouting::SNAPSHOT_NDJSON);
+	}
+
+	Simulator::Stop(Seconds(duration));
+	// only the events executed during the run, not the ones still pending at the stop
+	uint64_t executed = Simulator::GetEventCount ();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+	Simulator::Run ();
+	uint64_t events = Simulator::GetEventCount () - executed;
+	double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	uint64_t received = DynamicCast<UdpServer> (serverApps.Get (0))->GetReceived ();
+	uint32_t downwardRoutes = sinkRouting->GetNDownwardRoutes ();
+	if (snapshots)
+		flee.WriteSnapshot (nodes, snapshots, FleeRouting::SNAPSHOT_NDJSON);
+	// queueing and transmission delay over all hops, delivery delay at the sink per hop count
+	LrWpanFleeLatencyHistogram queueLatency;
+	LrWpanFleeLatencyHistogram txLatency;
+	std::vector<LrWpanFleeLatencyHistogram> deliveryLatency;
+	for (uint32_t d = 0; latencyStats && d < netdev.GetN (); d++){
+		Ptr<LrWpanFleeMac> mac = DynamicCast<LrWpanFleeMac> (netdev.Get(d)->GetObject<LrWpanNetDevice> ()->GetMac ());
+		queueLatency.Merge (mac->GetQueueLatency ());
+		txLatency.Merge (mac->GetTxLatency ());
+		if (d < (uint32_t)sinkRadios)
+			for (uint8_t hops = 0; hops < mac->GetMaxDeliveryHops (); hops++){
+				if (deliveryLatency.size () <= hops)
+					deliveryLatency.resize (hops + 1);
+				deliveryLatency[hops].Merge (mac->GetDeliveryLatency (hops));
+			}
+	}
+	Simulator::Destroy ();
+
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+
+	std::ostringstream json;
+	json << "{"
+		<< "\"nodes\":" << nNodes << ","
+		<< "\"sinkRadios\":" << sinkRadios << ","
+		<< "\"simSeconds\":" << duration << ","
+		<< "\"wallSeconds\":" << wall << ","
+		<< "\"simSecondsPerWallSecond\":" << duration / wall << ","
+		<< "\"eventsExecuted\":" << events << ","
+		<< "\"eventsPerWallSecond\":" << events / wall << ","
+		<< "\"peakRssKb\":" << usage.ru_maxrss << ","
+		<< "\"convergenceSeconds\":";
+	if (monitor.IsConverged ())
+		json << monitor.GetConvergenceTime ().GetSeconds ();
+	else
+		json << "null";
+	json << ",\"receivedPackets\":" << received;
+	if (registrationInterval > 0)
+		json << ",\"sinkDownwardRoutes\":" << downwardRoutes;
+	if (latencyStats){
+		json << ",\"queueLatencyMs\":";
+		WriteLatency (json, queueLatency);
+		json << ",\"txLatencyMs\":";
+		WriteLatency (json, txLatency);
+		json << ",\"sinkLatencyMsByHops\":[";
+		bool first = true;
+		for (uint32_t hops = 1; hops < deliveryLatency.size (); hops++)
+			if (deliveryLatency[hops].GetCount () > 0){
+				json << (first ? "" : ",") << "{\"hops\":" << hops << ",\"latency\":";
+				WriteLatency (json, deliveryLatency[hops]);
+				json << "}";
+				first = false;
+			}
+		json << "]";
+	}
+	if (replayTrace != "")
+		json << ",\"replayedRecords\":" << replay.GetSent () << ",\"skippedRecords\":" << replay.GetSkipped ();
+	json << "}\n";
+	// a single short write, so the line of a size is never split
+	std::string line = json.str ();
+	if (write (results[1], line.data (), line.size ()) != (ssize_t) line.size ())
+		NS_FATAL_ERROR ("Could not write the result of " << nNodes << " nodes");
+}
+
+// main function
+int main (int argc, char **argv){
+	// read input parameters, this is easier for starting scripts.
+	CommandLine cmd;
+	cmd.AddValue ("sizes","comma separated list of network sizes",sizes);
+	cmd.AddValue ("duration","simulated time per size in s",duration);
+	cmd.AddValue ("spacing","distance between neighbouring nodes in m",spacing);
+	cmd.AddValue ("gridRadius","cutoff radius of the spatial grid channel in m",gridRadius);
+	cmd.AddValue ("trafficStart","time at which the sensors start sending in s",trafficStart);
+	cmd.AddValue ("trafficInterval","time between two packets of a sensor in s",trafficInterval);
+	cmd.AddValue ("pktSize","size of the application packets in bytes",pktSize);
+	cmd.AddValue ("replayTrace","file of 32 byte FleeTraceRecords to send instead of the periodic traffic",replayTrace);
+	cmd.AddValue ("snapshotPrefix","write the routing tables at the end to <prefix>-<size>.ndjson (empty disables it)",snapshotPrefix);
+	cmd.AddValue ("snapshotInterval","also write the routing tables every interval in s (0 disables it)",snapshotInterval);
+	cmd.AddValue ("sinkRadios","number of radios of the sink, each on its own channels",sinkRadios);
+	cmd.AddValue ("registrationInterval","time between two registrations of a sensor for the routes from the sink in s (0 disables them)",registrationInterval);
+	cmd.AddValue ("latencyStats","report queueing, transmission and end-to-end delay percentiles",latencyStats);
+	cmd.Parse (argc,argv);
+	Config::SetDefault ("ns3::LrWpanFleeMac::LatencyStats", BooleanValue (latencyStats));
+	Config::SetDefault ("ns3::FleeRouting::RegistrationInterval", TimeValue (Seconds (registrationInterval)));
+
+	std::istringstream list (sizes);
+	std::string size;
+	while (std::getline (list, size, ','))
+		nodeCounts.push_back (std::stoul (size));
+
+	// one size at a time, so they do not compete for the cores or the memory
+	if (pipe (results) != 0)
+		NS_FATAL_ERROR ("Could not create the result pipe");
+	uint32_t failed = FleePartitionHelper::RunPartitions (nodeCounts.size (), MakeCallback (&RunSize), 1);
+	close (results[1]);
+	std::string lines;
+	char buf[4096];
+	ssize_t n;
+	while ((n = read (results[0], buf, sizeof (buf))) > 0)
+		lines.append (buf, n);
+	close (results[0]);
+
+	// a size whose process failed left no line, so the separators go between the ones that finished
+	std::cout << "[" << std::endl;
+	std::istringstream objects (lines);
+	std::string object;
+	for (bool first = true; std::getline (objects, object); first = false)
+		std::cout << (first ? "" : ",") << object << std::endl;
+	std::cout << "]" << std::endl;
+	return failed == 0 ? 0 : 1;
+}
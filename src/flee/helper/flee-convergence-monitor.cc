@@ -0,0 +1,157 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/simulator.h"
+#include "ns3/ipv6.h"
+#include "ns3/flee-routing-protocol.h"
+#include "ns3/lr-wpan-net-device.h"
+#include "ns3/lr-wpan-flee-mac.h"
+
+#include "flee-helper.h"
+#include "flee-convergence-monitor.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FleeConvergenceMonitor");
+
+FleeConvergenceMonitor::FleeConvergenceMonitor ()
+  : m_stableCycles (10),
+    m_interval (MilliSeconds (100)),
+    m_linkChanges (0),
+    m_stable (0),
+    m_converged (false)
+{
+}
+
+void
+FleeConvergenceMonitor::SetStableCycles (uint32_t cycles)
+{
+  m_stableCycles = cycles;
+}
+
+void
+FleeConvergenceMonitor::SetInterval (Time interval)
+{
+  NS_ASSERT (interval.IsStrictlyPositive ());
+  m_interval = interval;
+}
+
+void
+FleeConvergenceMonitor::Start (NodeContainer c, Callback<void> converged)
+{
+  NS_LOG_FUNCTION (this << c.GetN ());
+  FleeHelper helper;
+  m_routing.clear ();
+  m_macs.clear ();
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<FleeRouting> routing = DynamicCast<FleeRouting> (helper.GetRouting ((*i)->GetObject<Ipv6> ()));
+      NS_ASSERT_MSG (routing, "FleeRouting not installed on node " << (*i)->GetId ());
+      m_routing.push_back (routing);
+      for (uint32_t d = 0; d < (*i)->GetNDevices (); d++)
+        {
+          Ptr<LrWpanNetDevice> device = DynamicCast<LrWpanNetDevice> ((*i)->GetDevice (d));
+          Ptr<LrWpanFleeMac> mac = device ? DynamicCast<LrWpanFleeMac> (device->GetMac ()) : 0;
+          if (mac)
+            {
+              m_macs.push_back (mac);
+            }
+        }
+    }
+  m_distances.assign (m_routing.size (), 0);
+  m_linkChanges = 0;
+  m_stable = 0;
+  m_stableSince = Simulator::Now ();
+  m_converged = false;
+  m_callback = converged;
+  m_event.Cancel ();
+  m_event = Simulator::Schedule (m_interval, &FleeConvergenceMonitor::Check, this);
+}
+
+void
+FleeConvergenceMonitor::Stop (void)
+{
+  m_event.Cancel ();
+}
+
+bool
+FleeConvergenceMonitor::IsConverged (void) const
+{
+  return m_converged;
+}
+
+Time
+FleeConvergenceMonitor::GetConvergenceTime (void) const
+{
+  return m_stableSince;
+}
+
+void
+FleeConvergenceMonitor::Check (void)
+{
+  NS_LOG_FUNCTION (this);
+  bool changed = false;
+  bool routed = true;
+  for (uint32_t i = 0; i < m_routing.size (); i++)
+    {
+      uint8_t distance = m_routing[i]->GetDistanceToSink ();
+      if (distance != 0 && m_routing[i]->GetParents ().empty ())
+        {
+          routed = false;
+        }
+      if (distance != m_distances[i])
+        {
+          m_distances[i] = distance;
+          changed = true;
+        }
+    }
+  // the counters only go up, so an unchanged sum means no table changed
+  uint64_t linkChanges = 0;
+  for (std::vector<Ptr<LrWpanFleeMac> >::const_iterator it = m_macs.begin (); it != m_macs.end (); ++it)
+    {
+      linkChanges += (*it)->GetLinkChanges ();
+    }
+  if (linkChanges != m_linkChanges)
+    {
+      m_linkChanges = linkChanges;
+      changed = true;
+    }
+
+  if (changed || !routed)
+    {
+      m_stable = 0;
+      m_stableSince = Simulator::Now ();
+    }
+  else
+    {
+      m_stable++;
+    }
+
+  if (m_stable >= m_stableCycles)
+    {
+      NS_LOG_INFO ("FLEE network of " << m_routing.size () << " nodes converged at " << m_stableSince.GetSeconds () << " s");
+      m_converged = true;
+      m_callback ();
+      return;
+    }
+  m_event = Simulator::Schedule (m_interval, &FleeConvergenceMonitor::Check, this);
+}
+
+} // namespace ns3
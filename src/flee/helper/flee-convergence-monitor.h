@@ -0,0 +1,115 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef FLEE_CONVERGENCE_MONITOR_H
+#define FLEE_CONVERGENCE_MONITOR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/node-container.h"
+
+namespace ns3 {
+
+class FleeRouting;
+class LrWpanFleeMac;
+
+/**
+ * \brief Helper class that tells when a FLEE network has converged
+ *
+ * The monitor checks the nodes once per FLEE cycle.  The network has
+ * converged when every node is a sink or has a parent towards one, and
+ * neither the distances to the sink nor the neighbour tables of the FLEE
+ * MACs changed during the last K cycles.  The callback is then called once,
+ * so measurements can start as soon as the network is ready instead of after
+ * a fixed warm-up.
+ *
+ * The monitor has to stay alive until it fired or the simulation ended.
+ */
+class FleeConvergenceMonitor
+{
+public:
+  /**
+   * \brief Constructor.
+   */
+  FleeConvergenceMonitor ();
+
+  /**
+   * \brief Set the number of cycles the network has to be stable.
+   * \param cycles the number of cycles, 10 by default
+   */
+  void SetStableCycles (uint32_t cycles);
+
+  /**
+   * \brief Set the time between two checks.
+   * \param interval the interval, the 100 ms FLEE cycle by default
+   */
+  void SetInterval (Time interval);
+
+  /**
+   * \brief Start watching the nodes.
+   *
+   * Call it after the FLEE devices and FleeRouting are installed.
+   *
+   * \param c the nodes to watch
+   * \param converged called once when the network has converged
+   */
+  void Start (NodeContainer c, Callback<void> converged);
+
+  /**
+   * \brief Stop watching the nodes without calling the callback.
+   */
+  void Stop (void);
+
+  /**
+   * \return true if the network has converged
+   */
+  bool IsConverged (void) const;
+
+  /**
+   * \return the time at which the network converged, the time at which it
+   * became stable and not the time the callback was called
+   */
+  Time GetConvergenceTime (void) const;
+
+private:
+  /**
+   * \brief Check the nodes and schedule the next check.
+   */
+  void Check (void);
+
+  uint32_t m_stableCycles;                     //!< cycles the network has to be stable
+  Time m_interval;                             //!< time between two checks
+  std::vector<Ptr<FleeRouting> > m_routing;    //!< routing of every node
+  std::vector<Ptr<LrWpanFleeMac> > m_macs;     //!< every FLEE MAC of the nodes
+  std::vector<uint8_t> m_distances;            //!< distance of every node at the last check
+  uint64_t m_linkChanges;                      //!< link changes of all MACs at the last check
+  uint32_t m_stable;                           //!< checks without a change
+  Time m_stableSince;                          //!< time of the last change
+  bool m_converged;                            //!< true once the callback is called
+  Callback<void> m_callback;                   //!< called when converged
+  EventId m_event;                             //!< the next check
+};
+
+} // namespace ns3
+
+#endif /* FLEE_CONVERGENCE_MONITOR_H */
@@ -17,6 +17,10 @@
  */
 
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 
 #include "ns3/log.h"
 #include "ns3/ptr.h"
@@ -29,6 +33,10 @@
 #include "ns3/ipv6-address.h"
 #include "ns3/ipv6-routing-protocol.h"
 #include "ns3/flee-routing-protocol.h"
+#include "ns3/simulator.h"
+#include "ns3/abort.h"
+#include "ns3/lr-wpan-net-device.h"
+#include "ns3/lr-wpan-flee-mac.h"
 
 #include "flee-helper.h"
 
@@ -86,4 +94,186 @@ FleeHelper::GetRouting (Ptr<Ipv6> ipv6) const
   return 0;
 }
 
+int64_t
+FleeHelper::AssignStreams (NodeContainer c, int64_t stream)
+{
+  int64_t currentStream = stream;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<Ipv6> ipv6 = (*i)->GetObject<Ipv6> ();
+      NS_ASSERT_MSG (ipv6, "Ipv6 not installed on node");
+      Ptr<FleeRouting> flee = DynamicCast<FleeRouting> (GetRouting (ipv6));
+      if (flee)
+        {
+          currentStream += flee->AssignStreams (currentStream);
+        }
+    }
+  return (currentStream - stream);
+}
+
+/// first bytes of a checkpoint file, the last one is the format version
+static const char FLEE_CHECKPOINT_MAGIC[] = { 'F', 'L', 'E', 'E', 'C', 'K', 'P', 3 };
+
+/**
+ * \brief Get the FLEE MACs of a node.
+ * \param node the node
+ * \return the MAC of every LR-WPAN device with a FLEE MAC, with its device index
+ */
+static std::vector<std::pair<uint32_t, Ptr<LrWpanFleeMac> > >
+GetFleeMacs (Ptr<Node> node)
+{
+  std::vector<std::pair<uint32_t, Ptr<LrWpanFleeMac> > > macs;
+  for (uint32_t i = 0; i < node->GetNDevices (); i++)
+    {
+      Ptr<LrWpanNetDevice> device = DynamicCast<LrWpanNetDevice> (node->GetDevice (i));
+      Ptr<LrWpanFleeMac> mac = device ? DynamicCast<LrWpanFleeMac> (device->GetMac ()) : 0;
+      if (mac)
+        {
+          macs.push_back (std::make_pair (i, mac));
+        }
+    }
+  return macs;
+}
+
+void
+FleeHelper::SaveCheckpoint (NodeContainer c, std::string filename) const
+{
+  std::ofstream file (filename.c_str (), std::ios::binary);
+  NS_ABORT_MSG_UNLESS (file, "Cannot write checkpoint " << filename);
+  file.write (FLEE_CHECKPOINT_MAGIC, sizeof (FLEE_CHECKPOINT_MAGIC));
+  uint32_t nNodes = c.GetN ();
+  file.write ((const char *) &nNodes, sizeof (nNodes));
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      // every node is a record with its size in front
+      std::ostringstream record;
+      Ptr<FleeRouting> flee = DynamicCast<FleeRouting> (GetRouting ((*i)->GetObject<Ipv6> ()));
+      NS_ABORT_MSG_UNLESS (flee, "FleeRouting not installed on node " << (*i)->GetId ());
+      flee->SaveState (record);
+      std::vector<std::pair<uint32_t, Ptr<LrWpanFleeMac> > > macs = GetFleeMacs (*i);
+      uint32_t nMacs = macs.size ();
+      record.write ((const char *) &nMacs, sizeof (nMacs));
+      for (uint32_t m = 0; m < nMacs; m++)
+        {
+          record.write ((const char *) &macs[m].first, sizeof (uint32_t));
+          macs[m].second->SaveState (record);
+        }
+      uint32_t id = (*i)->GetId ();
+      std::string data = record.str ();
+      uint32_t size = data.size ();
+      file.write ((const char *) &id, sizeof (id));
+      file.write ((const char *) &size, sizeof (size));
+      file.write (data.data (), size);
+    }
+  NS_ABORT_MSG_UNLESS (file, "Cannot write checkpoint " << filename);
+}
+
+/**
+ * \brief Apply the records of a checkpoint to the nodes.
+ * \param records the node and its saved state, on node id
+ */
+static void
+ApplyCheckpoint (std::map<uint32_t, std::pair<Ptr<Node>, std::string> > records)
+{
+  FleeHelper helper;
+  for (std::map<uint32_t, std::pair<Ptr<Node>, std::string> >::iterator it = records.begin (); it != records.end (); ++it)
+    {
+      Ptr<Node> node = it->second.first;
+      std::istringstream record (it->second.second);
+      Ptr<FleeRouting> flee = DynamicCast<FleeRouting> (helper.GetRouting (node->GetObject<Ipv6> ()));
+      NS_ABORT_MSG_UNLESS (flee, "FleeRouting not installed on node " << node->GetId ());
+      flee->RestoreState (record);
+      uint32_t nMacs = 0;
+      record.read ((char *) &nMacs, sizeof (nMacs));
+      for (uint32_t m = 0; m < nMacs && record; m++)
+        {
+          uint32_t index = 0;
+          record.read ((char *) &index, sizeof (index));
+          Ptr<LrWpanNetDevice> device = index < node->GetNDevices () ? DynamicCast<LrWpanNetDevice> (node->GetDevice (index)) : 0;
+          Ptr<LrWpanFleeMac> mac = device ? DynamicCast<LrWpanFleeMac> (device->GetMac ()) : 0;
+          NS_ABORT_MSG_UNLESS (mac, "Device " << index << " of node " << node->GetId () << " has no FLEE MAC");
+          mac->RestoreState (record);
+        }
+      NS_ABORT_MSG_UNLESS (record, "Truncated checkpoint record for node " << node->GetId ());
+    }
+}
+
+void
+FleeHelper::RestoreCheckpoint (NodeContainer c, std::string filename) const
+{
+  std::ifstream file (filename.c_str (), std::ios::binary);
+  NS_ABORT_MSG_UNLESS (file, "Cannot read checkpoint " << filename);
+  char magic[sizeof (FLEE_CHECKPOINT_MAGIC)];
+  file.read (magic, sizeof (magic));
+  NS_ABORT_MSG_UNLESS (file && std::equal (magic, magic + sizeof (magic), FLEE_CHECKPOINT_MAGIC),
+                       filename << " is not a FLEE checkpoint of this version");
+
+  std::map<uint32_t, Ptr<Node> > nodes;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      nodes[(*i)->GetId ()] = *i;
+    }
+  std::map<uint32_t, std::pair<Ptr<Node>, std::string> > records;
+  uint32_t nNodes = 0;
+  file.read ((char *) &nNodes, sizeof (nNodes));
+  for (uint32_t n = 0; n < nNodes && file; n++)
+    {
+      uint32_t id = 0;
+      uint32_t size = 0;
+      file.read ((char *) &id, sizeof (id));
+      file.read ((char *) &size, sizeof (size));
+      std::string data (size, 0);
+      file.read (&data[0], size);
+      // records of nodes that are not in the container are skipped
+      std::map<uint32_t, Ptr<Node> >::iterator node = nodes.find (id);
+      if (node != nodes.end ())
+        {
+          records[id] = std::make_pair (node->second, data);
+        }
+    }
+  NS_ABORT_MSG_UNLESS (file, "Truncated checkpoint " << filename);
+  // runs after the initialization of the nodes, which is scheduled when they are created
+  Simulator::Schedule (Seconds (0), &ApplyCheckpoint, records);
+}
+
+void
+FleeHelper::WriteSnapshot (NodeContainer c, Ptr<OutputStreamWrapper> stream,
+                           FleeRouting::SnapshotFormat format) const
+{
+  std::ostream *os = stream->GetStream ();
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<Ipv6> ipv6 = (*i)->GetObject<Ipv6> ();
+      Ptr<FleeRouting> flee = ipv6 ? DynamicCast<FleeRouting> (GetRouting (ipv6)) : 0;
+      if (flee)
+        {
+          flee->WriteSnapshot (*os, format);
+        }
+    }
+}
+
+/**
+ * \brief Write a snapshot and schedule the next one.
+ * \param interval the time between two snapshots
+ * \param c the nodes to write the tables of
+ * \param stream the output stream
+ * \param format the encoding of the records
+ */
+static void
+WriteSnapshotPeriodically (Time interval, NodeContainer c, Ptr<OutputStreamWrapper> stream,
+                           FleeRouting::SnapshotFormat format)
+{
+  FleeHelper helper;
+  helper.WriteSnapshot (c, stream, format);
+  Simulator::Schedule (interval, &WriteSnapshotPeriodically, interval, c, stream, format);
+}
+
+void
+FleeHelper::WriteSnapshotEvery (Time interval, NodeContainer c, Ptr<OutputStreamWrapper> stream,
+                                FleeRouting::SnapshotFormat format) const
+{
+  NS_ASSERT (interval.IsStrictlyPositive ());
+  Simulator::Schedule (interval, &WriteSnapshotPeriodically, interval, c, stream, format);
+}
+
 } // namespace ns3
@@ -29,6 +29,10 @@
 #include "ns3/node-container.h"
 #include "ns3/net-device-container.h"
 #include "ns3/ipv6-routing-helper.h"
+#include "ns3/output-stream-wrapper.h"
+#include "ns3/nstime.h"
+
+#include <string>
 
 namespace ns3 {
 
@@ -75,6 +79,72 @@ public:
    */
   Ptr<Ipv6RoutingProtocol> GetRouting (Ptr<Ipv6> ipv6) const;
 
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by the FLEE routing protocols on the given nodes.  Return the number
+   * of streams (possibly zero) that have been assigned.  The Install ()
+   * method of the InternetStackHelper should have previously been called.
+   *
+   * \param c NodeContainer of the set of nodes for which FleeRouting
+   *          should be modified to use a fixed stream
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this helper
+   */
+  int64_t AssignStreams (NodeContainer c, int64_t stream);
+
+  /**
+   * \brief Save the converged state of the FLEE network to a file.
+   *
+   * For every node the distance, path ETX and parents of FleeRouting are
+   * saved, and for every LrWpanFleeMac the neighbour table, the link and
+   * channel statistics and the phase of the slot cycle.  Schedule it at the
+   * end of the warm-up of a run.
+   *
+   * \param c the nodes to save
+   * \param filename the checkpoint file
+   */
+  void SaveCheckpoint (NodeContainer c, std::string filename) const;
+
+  /**
+   * \brief Restore the state of a FLEE network from a file.
+   *
+   * The file is read right away and applied at the start of the simulation,
+   * after the nodes are initialized.  Nodes are matched on their id, so the
+   * topology has to be built in the same order as in the run that saved it.
+   * Queued packets and the neighbour caches of IPv6 are not restored.
+   *
+   * \param c the nodes to restore
+   * \param filename the checkpoint file
+   */
+  void RestoreCheckpoint (NodeContainer c, std::string filename) const;
+
+  /**
+   * \brief Write the routing tables of the nodes as compact records.
+   *
+   * Unlike PrintRoutingTableAllAt, which formats a table per node, this
+   * writes one record per route, see FleeRouting::WriteSnapshot.  Open the
+   * stream in binary mode for SNAPSHOT_BINARY.
+   *
+   * \param c the nodes to write the tables of
+   * \param stream the output stream
+   * \param format the encoding of the records
+   */
+  void WriteSnapshot (NodeContainer c, Ptr<OutputStreamWrapper> stream,
+                      FleeRouting::SnapshotFormat format) const;
+
+  /**
+   * \brief Write the routing tables of the nodes every interval.
+   *
+   * All snapshots go to the same stream, the records carry their time.
+   *
+   * \param interval the time between two snapshots, the first one is after one interval
+   * \param c the nodes to write the tables of
+   * \param stream the output stream
+   * \param format the encoding of the records
+   */
+  void WriteSnapshotEvery (Time interval, NodeContainer c, Ptr<OutputStreamWrapper> stream,
+                           FleeRouting::SnapshotFormat format) const;
+
 private:
   /**
    * \brief Assignment operator declared private and not implemented to disallow
@@ -0,0 +1,212 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+
+#include "flee-partition-helper.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FleePartitionHelper");
+
+FleePartitionHelper::FleePartitionHelper ()
+  : m_cutoffRadius (100.0),
+    m_nClusters (0)
+{
+}
+
+void
+FleePartitionHelper::SetCutoffRadius (double radius)
+{
+  NS_LOG_FUNCTION (this << radius);
+  NS_ASSERT_MSG (radius > 0, "Partitioning requires a positive cutoff radius");
+  m_cutoffRadius = radius;
+}
+
+uint32_t
+FleePartitionHelper::FindRoot (std::vector<uint32_t> &parent, uint32_t i)
+{
+  while (parent[i] != i)
+    {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+  return i;
+}
+
+std::vector<uint32_t>
+FleePartitionHelper::Partition (const std::vector<Vector> &positions, uint32_t nPartitions)
+{
+  NS_LOG_FUNCTION (this << positions.size () << nPartitions);
+  NS_ASSERT (nPartitions > 0);
+
+  // bin the nodes in cells of the cutoff radius, so only neighbouring cells
+  // have to be compared
+  typedef std::pair<int64_t, int64_t> Cell;
+  std::map<Cell, std::vector<uint32_t> > cells;
+  for (uint32_t i = 0; i < positions.size (); i++)
+    {
+      Cell cell (static_cast<int64_t> (std::floor (positions[i].x / m_cutoffRadius)),
+                 static_cast<int64_t> (std::floor (positions[i].y / m_cutoffRadius)));
+      cells[cell].push_back (i);
+    }
+
+  // join every pair of nodes within the cutoff radius in one cluster
+  std::vector<uint32_t> parent (positions.size ());
+  for (uint32_t i = 0; i < parent.size (); i++)
+    {
+      parent[i] = i;
+    }
+  for (std::map<Cell, std::vector<uint32_t> >::const_iterator it = cells.begin (); it != cells.end (); ++it)
+    {
+      for (int64_t dx = -1; dx <= 1; dx++)
+        {
+          for (int64_t dy = -1; dy <= 1; dy++)
+            {
+              std::map<Cell, std::vector<uint32_t> >::const_iterator other =
+                cells.find (Cell (it->first.first + dx, it->first.second + dy));
+              if (other == cells.end ())
+                {
+                  continue;
+                }
+              for (std::vector<uint32_t>::const_iterator a = it->second.begin (); a != it->second.end (); ++a)
+                {
+                  for (std::vector<uint32_t>::const_iterator b = other->second.begin (); b != other->second.end (); ++b)
+                    {
+                      if (*a < *b && CalculateDistance (positions[*a], positions[*b]) <= m_cutoffRadius)
+                        {
+                          parent[FindRoot (parent, *a)] = FindRoot (parent, *b);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+  // collect the clusters
+  std::map<uint32_t, std::vector<uint32_t> > clusters;
+  for (uint32_t i = 0; i < parent.size (); i++)
+    {
+      clusters[FindRoot (parent, i)].push_back (i);
+    }
+  m_nClusters = clusters.size ();
+  NS_LOG_INFO ("Found " << m_nClusters << " clusters in " << positions.size () << " nodes");
+  if (m_nClusters < nPartitions)
+    {
+      NS_LOG_WARN ("Only " << m_nClusters << " clusters for " << nPartitions << " partitions");
+    }
+
+  // place the largest clusters first, each in the partition with the fewest nodes
+  std::vector<std::pair<uint32_t, uint32_t> > order;
+  for (std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = clusters.begin (); it != clusters.end (); ++it)
+    {
+      order.push_back (std::make_pair (it->second.size (), it->first));
+    }
+  std::sort (order.rbegin (), order.rend ());
+
+  std::vector<uint32_t> load (nPartitions, 0);
+  std::vector<uint32_t> partition (positions.size (), 0);
+  for (std::vector<std::pair<uint32_t, uint32_t> >::const_iterator it = order.begin (); it != order.end (); ++it)
+    {
+      uint32_t target = std::min_element (load.begin (), load.end ()) - load.begin ();
+      const std::vector<uint32_t> &members = clusters[it->second];
+      for (std::vector<uint32_t>::const_iterator m = members.begin (); m != members.end (); ++m)
+        {
+          partition[*m] = target;
+        }
+      load[target] += it->first;
+    }
+  return partition;
+}
+
+uint32_t
+FleePartitionHelper::GetNClusters (void) const
+{
+  return m_nClusters;
+}
+
+uint32_t
+FleePartitionHelper::RunPartitions (uint32_t nPartitions, Callback<void, uint32_t> body, uint32_t maxParallel)
+{
+  NS_LOG_FUNCTION (nPartitions << maxParallel);
+  uint32_t failed = 0;
+  uint32_t running = 0;
+  // do not let every child print what is still buffered
+  std::cout.flush ();
+  fflush (0);
+  for (uint32_t p = 0; p < nPartitions; p++)
+    {
+      if (maxParallel > 0 && running >= maxParallel)
+        {
+          int status;
+          if (wait (&status) > 0)
+            {
+              running--;
+              if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+                {
+                  failed++;
+                }
+            }
+        }
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          // the child simulates one partition with its own simulator
+          body (p);
+          std::cout.flush ();
+          std::cerr.flush ();
+          fflush (0);
+          _exit (0);
+        }
+      else if (pid < 0)
+        {
+          NS_LOG_ERROR ("Could not fork partition " << p);
+          failed++;
+        }
+      else
+        {
+          running++;
+        }
+    }
+  while (running > 0)
+    {
+      int status;
+      if (wait (&status) <= 0)
+        {
+          break;
+        }
+      running--;
+      if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          failed++;
+        }
+    }
+  return failed;
+}
+
+} // namespace ns3
@@ -0,0 +1,112 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef FLEE_PARTITION_HELPER_H
+#define FLEE_PARTITION_HELPER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "ns3/vector.h"
+#include "ns3/callback.h"
+
+namespace ns3 {
+
+/**
+ * \brief Helper class that splits a FLEE deployment in independent partitions
+ *
+ * The ns-3 simulator is a process-wide singleton, so a single scenario cannot
+ * run several event queues on different cores.  Deployments of many FLEE
+ * trees that are further apart than the radio range do however not exchange
+ * a single event, so they can be simulated in separate processes.
+ *
+ * Partition () groups the positions into clusters: two nodes closer than the
+ * cutoff radius always end up in the same cluster.  The clusters are then
+ * spread over the requested number of partitions, balancing the number of
+ * nodes.  Nodes of different partitions are thus at least the cutoff radius
+ * apart.  With an LrWpanGridSpectrumChannel using the same cutoff radius, no
+ * signal ever crosses a partition and the partitions are fully decoupled.
+ *
+ * RunPartitions () forks one process per partition, so every partition runs
+ * its own Simulator::Run on its own core.  The scenario builds only the nodes
+ * of its partition in the callback, and hands its results to the parent
+ * process, e.g. through a pipe.
+ *
+ * This is not a parallel discrete event simulation: the processes never
+ * exchange events, so trees that are within radio range of each other,
+ * however weakly, share a cluster and run in the same process.  A
+ * conservative scheme that splits such trees was not worth it.  Its
+ * lookahead is bounded by the propagation delay between the partitions,
+ * about 0.3 us at 100 m, and not by the 10 ms FLEE slot: a frame and its
+ * acknowledgement cross the boundary within one slot, and so does the
+ * interference of every transmission.  Synchronising 64 processes every
+ * 0.3 us of simulated time costs far more than the events in between.
+ */
+class FleePartitionHelper
+{
+public:
+  /**
+   * \brief Constructor.
+   */
+  FleePartitionHelper ();
+
+  /**
+   * \brief Set the distance beyond which two nodes do not interact.
+   * \param radius the cutoff radius in meters, use the one of the channel
+   */
+  void SetCutoffRadius (double radius);
+
+  /**
+   * \brief Split the positions of a deployment in partitions.
+   * \param positions the position of every node
+   * \param nPartitions the number of partitions to create
+   * \return the partition of every node, in the order of positions
+   */
+  std::vector<uint32_t> Partition (const std::vector<Vector> &positions, uint32_t nPartitions);
+
+  /**
+   * \return the number of clusters found by the last Partition () call
+   */
+  uint32_t GetNClusters (void) const;
+
+  /**
+   * \brief Run every partition in its own process.
+   * \param nPartitions the number of partitions
+   * \param body called in the child process with the partition to simulate
+   * \param maxParallel the maximum number of processes running at once, 0 for no limit
+   * \return the number of partitions that did not finish successfully
+   */
+  static uint32_t RunPartitions (uint32_t nPartitions, Callback<void, uint32_t> body, uint32_t maxParallel = 0);
+
+private:
+  /**
+   * \brief Find the cluster a node belongs to.
+   * \param parent the union-find forest
+   * \param i the node
+   * \return the root of the cluster
+   */
+  static uint32_t FindRoot (std::vector<uint32_t> &parent, uint32_t i);
+
+  double m_cutoffRadius;  //!< distance beyond which nodes do not interact
+  uint32_t m_nClusters;   //!< clusters found by the last partitioning
+};
+
+} // namespace ns3
+
+#endif /* FLEE_PARTITION_HELPER_H */
+
@@ -0,0 +1,212 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/simulator.h"
+#include "ns3/node.h"
+#include "ns3/node-list.h"
+#include "ns3/packet.h"
+#include "ns3/ipv6-address.h"
+#include "ns3/inet6-socket-address.h"
+#include "ns3/udp-socket-factory.h"
+
+#include "flee-trace-replay.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("FleeTraceReplay");
+
+/// records that are replayed before their pages are handed back, 64 MiB
+static const uint64_t FLEE_REPLAY_RELEASE_RECORDS = 1 << 21;
+
+FleeTraceReplay::FleeTraceReplay ()
+  : m_records (0),
+    m_nRecords (0),
+    m_next (0),
+    m_released (0),
+    m_sent (0),
+    m_skipped (0)
+{
+  NS_ASSERT (sizeof (FleeTraceRecord) == 32);
+}
+
+FleeTraceReplay::~FleeTraceReplay ()
+{
+  Close ();
+}
+
+void
+FleeTraceReplay::Open (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  Close ();
+  int fd = open (filename.c_str (), O_RDONLY);
+  NS_ABORT_MSG_IF (fd < 0, "Cannot open trace " << filename);
+  struct stat st;
+  NS_ABORT_MSG_IF (fstat (fd, &st) != 0, "Cannot stat trace " << filename);
+  NS_ABORT_MSG_IF (st.st_size % sizeof (FleeTraceRecord) != 0,
+                   filename << " is not a trace of " << sizeof (FleeTraceRecord) << " byte records");
+  m_nRecords = st.st_size / sizeof (FleeTraceRecord);
+  if (m_nRecords > 0)
+    {
+      void *map = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      NS_ABORT_MSG_IF (map == MAP_FAILED, "Cannot map trace " << filename);
+      // the kernel reads ahead and drops what is behind
+      madvise (map, st.st_size, MADV_SEQUENTIAL);
+      m_records = static_cast<const FleeTraceRecord *> (map);
+    }
+  // the mapping keeps the file open
+  close (fd);
+  m_next = 0;
+  m_released = 0;
+}
+
+void
+FleeTraceReplay::Close (void)
+{
+  m_event.Cancel ();
+  if (m_records)
+    {
+      munmap (const_cast<FleeTraceRecord *> (m_records), m_nRecords * sizeof (FleeTraceRecord));
+      m_records = 0;
+    }
+  m_nRecords = 0;
+}
+
+void
+FleeTraceReplay::Start (Time offset)
+{
+  NS_LOG_FUNCTION (this << offset);
+  m_offset = offset;
+  m_event.Cancel ();
+  ScheduleNext ();
+}
+
+void
+FleeTraceReplay::Stop (void)
+{
+  m_event.Cancel ();
+}
+
+uint64_t
+FleeTraceReplay::GetNRecords (void) const
+{
+  return m_nRecords;
+}
+
+uint64_t
+FleeTraceReplay::GetSent (void) const
+{
+  return m_sent;
+}
+
+uint64_t
+FleeTraceReplay::GetSkipped (void) const
+{
+  return m_skipped;
+}
+
+void
+FleeTraceReplay::ScheduleNext (void)
+{
+  if (m_next >= m_nRecords)
+    {
+      NS_LOG_INFO ("Trace replayed, " << m_sent << " records sent, " << m_skipped << " skipped");
+      return;
+    }
+  const FleeTraceRecord &record = m_records[m_next];
+  Time delay = m_offset + NanoSeconds (record.time) - Simulator::Now ();
+  if (delay.IsNegative ())
+    {
+      delay = Seconds (0);
+    }
+  m_event = Simulator::ScheduleWithContext (record.node, delay, &FleeTraceReplay::Replay, this);
+}
+
+void
+FleeTraceReplay::Replay (void)
+{
+  Time now = Simulator::Now ();
+  // records of the same time are sent in one event
+  while (m_next < m_nRecords && m_offset + NanoSeconds (m_records[m_next].time) <= now)
+    {
+      const FleeTraceRecord &record = m_records[m_next++];
+      Ptr<Socket> socket = GetSocket (record.node);
+      if (!socket)
+        {
+          m_skipped++;
+          continue;
+        }
+      // this event runs in the context of the node of the first record
+      if (record.node == Simulator::GetContext ())
+        {
+          Send (socket, record);
+        }
+      else
+        {
+          Simulator::ScheduleWithContext (record.node, Seconds (0), &FleeTraceReplay::Send, this, socket, record);
+        }
+    }
+  // hand the pages that were replayed back to the kernel
+  if (m_next - m_released >= FLEE_REPLAY_RELEASE_RECORDS)
+    {
+      uint64_t page = sysconf (_SC_PAGESIZE);
+      uint64_t begin = (m_released * sizeof (FleeTraceRecord)) / page * page;
+      uint64_t end = (m_next * sizeof (FleeTraceRecord)) / page * page;
+      madvise ((char *) m_records + begin, end - begin, MADV_DONTNEED);
+      m_released = m_next;
+    }
+  ScheduleNext ();
+}
+
+void
+FleeTraceReplay::Send (Ptr<Socket> socket, FleeTraceRecord record)
+{
+  Ipv6Address destination = Ipv6Address::Deserialize (record.destination);
+  socket->SendTo (Create<Packet> (record.size), 0, Inet6SocketAddress (destination, record.port));
+  m_sent++;
+}
+
+Ptr<Socket>
+FleeTraceReplay::GetSocket (uint32_t node)
+{
+  // Socket::CreateSocket aborts on a node without the factory
+  if (node >= NodeList::GetNNodes () || !NodeList::GetNode (node)->GetObject<UdpSocketFactory> ())
+    {
+      return 0;
+    }
+  if (node >= m_sockets.size ())
+    {
+      m_sockets.resize (node + 1);
+    }
+  if (!m_sockets[node])
+    {
+      Ptr<Socket> socket = Socket::CreateSocket (NodeList::GetNode (node), UdpSocketFactory::GetTypeId ());
+      socket->Bind (Inet6SocketAddress (Ipv6Address::GetAny (), 0));
+      m_sockets[node] = socket;
+    }
+  return m_sockets[node];
+}
+
+} // namespace ns3
@@ -0,0 +1,153 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 University of Washington
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef FLEE_TRACE_REPLAY_H
+#define FLEE_TRACE_REPLAY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/socket.h"
+
+namespace ns3 {
+
+/**
+ * \brief One packet of a FLEE traffic trace, as stored in the file
+ *
+ * All fields are little-endian.  The records of a file are sorted on time.
+ */
+struct FleeTraceRecord
+{
+  uint64_t time;             //!< send time in ns from the start of the replay
+  uint32_t node;             //!< id of the sending node
+  uint16_t size;             //!< UDP payload size in bytes
+  uint16_t port;             //!< UDP destination port
+  uint8_t destination[16];   //!< IPv6 destination address
+};
+
+/**
+ * \brief Helper class that replays a recorded traffic trace
+ *
+ * The trace is a file of 32-byte FleeTraceRecords.  It is memory-mapped and
+ * read one record at a time, so traces of hundreds of millions of records
+ * do not have to fit in memory: the pages that were replayed are handed
+ * back to the kernel.  The replay has one pending event at the time of the
+ * next record, and records of the same time from other nodes are sent from
+ * an event in the context of their node.  Every record becomes a UDP packet
+ * sent by its node through the IPv6 stack, so it is routed by FleeRouting
+ * like any other traffic.  The UDP socket of a node is only created when
+ * the node sends its first record.
+ *
+ * Records of nodes that do not exist or have no UDP are counted and
+ * skipped.  The replay has to stay alive until it is done or the
+ * simulation ended.
+ */
+class FleeTraceReplay
+{
+public:
+  /**
+   * \brief Constructor.
+   */
+  FleeTraceReplay ();
+
+  /**
+   * \brief Destructor, unmaps the trace.
+   */
+  ~FleeTraceReplay ();
+
+  /**
+   * \brief Map a trace file.
+   * \param filename the trace file
+   */
+  void Open (std::string filename);
+
+  /**
+   * \brief Start sending the records.
+   * \param offset the simulation time that corresponds to time 0 of the trace,
+   * records from before the time the replay starts are sent right away
+   */
+  void Start (Time offset);
+
+  /**
+   * \brief Stop sending records.
+   */
+  void Stop (void);
+
+  /**
+   * \return the number of records in the trace
+   */
+  uint64_t GetNRecords (void) const;
+
+  /**
+   * \return the number of records that were sent
+   */
+  uint64_t GetSent (void) const;
+
+  /**
+   * \return the number of records that were skipped because their node does
+   * not exist or has no UDP
+   */
+  uint64_t GetSkipped (void) const;
+
+private:
+  /**
+   * \brief Send every record that is due and schedule the next one.
+   */
+  void Replay (void);
+
+  /**
+   * \brief Send one record, in the context of its node.
+   * \param socket the socket of the node
+   * \param record the record
+   */
+  void Send (Ptr<Socket> socket, FleeTraceRecord record);
+
+  /**
+   * \brief Schedule the event of the next record.
+   */
+  void ScheduleNext (void);
+
+  /**
+   * \brief Get the socket of a node, create it on first use.
+   * \param node the node id
+   * \return the socket, 0 if the node does not exist or has no UDP
+   */
+  Ptr<Socket> GetSocket (uint32_t node);
+
+  /**
+   * \brief Unmap the trace.
+   */
+  void Close (void);
+
+  const FleeTraceRecord *m_records;        //!< the mapped trace
+  uint64_t m_nRecords;                     //!< records in the trace
+  uint64_t m_next;                         //!< next record to send
+  uint64_t m_released;                     //!< records whose pages were handed back
+  Time m_offset;                           //!< simulation time of trace time 0
+  std::vector<Ptr<Socket> > m_sockets;     //!< socket of every node that sent, on node id
+  uint64_t m_sent;                         //!< records sent
+  uint64_t m_skipped;                      //!< records of unknown nodes or nodes without UDP
+  EventId m_event;                         //!< the next record
+};
+
+} // namespace ns3
+
+#endif /* FLEE_TRACE_REPLAY_H */
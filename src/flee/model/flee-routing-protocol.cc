@@ -18,7 +18,12 @@
  * Author: Brecht Reynders <brecht.reynders@esat.kuleuven.be>
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
+#include <vector>
+#include <istream>
+#include <ostream>
 #include "ns3/log.h"
 #include "ns3/node.h"
 #include "ns3/packet.h"
@@ -29,11 +34,24 @@
 #include "ns3/uinteger.h"
 #include "ns3/string.h"
 #include "ns3/pointer.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/nstime.h"
 #include "ns3/socket.h"
 #include "ns3/udp-socket-factory.h"
+#include "ns3/udp-header.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/ipv6-packet-info-tag.h"
+#include "ns3/inet6-socket-address.h"
 
 #include "ns3/ipv6-l3-protocol.h"
 #include <ns3/ipv6-routing-table-entry.h>
+#include <ns3/lr-wpan-flee-profiler.h>
+#include <ns3/lr-wpan-flee-mac.h>
+#include <ns3/lr-wpan-flee-state.h>
+#include <ns3/lr-wpan-flee-timestamp-tag.h>
+#include <ns3/lr-wpan-net-device.h>
+#include <ns3/sixlowpan-net-device.h>
 #include "flee-routing-protocol.h"
 
 namespace ns3 {
@@ -42,6 +60,59 @@ NS_LOG_COMPONENT_DEFINE ("FleeRouting");
 
 NS_OBJECT_ENSURE_REGISTERED (FleeRouting);
 
+/// bytes in front of every reading in an aggregate: interface identifier of
+/// the source, remaining hop limit, UDP ports and payload length
+static const uint32_t AGGREGATE_RECORD_HEADER = 14;
+
+/// path ETX of a node without a path to the sink, the largest value a hello can carry
+static const double FLEE_NO_PATH_ETX = 0xffff / 10.0;
+
+/// first byte of a registration, followed by the global address of the registered node
+static const uint8_t FLEE_REGISTRATION = 0xff;
+
+/// registration intervals a downward route lives without a new registration
+static const double FLEE_REGISTRATION_LIFETIME = 3;
+
+/// mark a routing control message, so the FLEE MACs leave it out of the delivery latency
+static void
+MarkControl (Ptr<Packet> pkt)
+{
+  LrWpanFleeTimestampTag tag;
+  tag.SetOrigin (Simulator::Now ());
+  tag.SetControl (true);
+  pkt->ReplacePacketTag (tag);
+}
+
+/// write one route of a routing table snapshot
+static void
+WriteSnapshotRecord (std::ostream &os, FleeRouting::SnapshotFormat format, int64_t time, uint32_t node,
+                     Ipv6Address dst, uint8_t prefix, Ipv6Address nextHop, uint32_t metric, uint8_t distance)
+{
+  if (format == FleeRouting::SNAPSHOT_BINARY)
+    {
+      uint8_t buf[16];
+      WriteState<int64_t> (os, time);
+      WriteState<uint32_t> (os, node);
+      dst.GetBytes (buf);
+      os.write ((const char *) buf, 16);
+      WriteState<uint8_t> (os, prefix);
+      nextHop.GetBytes (buf);
+      os.write ((const char *) buf, 16);
+      WriteState<uint32_t> (os, metric);
+      WriteState<uint8_t> (os, distance);
+    }
+  else
+    {
+      os << "{\"time\":" << time
+         << ",\"node\":" << node
+         << ",\"dst\":\"" << dst
+         << "\",\"prefix\":" << (uint32_t) prefix
+         << ",\"nextHop\":\"" << nextHop
+         << "\",\"metric\":" << metric
+         << ",\"distance\":" << (uint32_t) distance << "}\n";
+    }
+}
+
 TypeId FleeRouting::GetTypeId ()
 {
   static TypeId tid = TypeId ("ns3::FleeRouting")
@@ -58,6 +129,51 @@ TypeId FleeRouting::GetTypeId ()
 										UintegerValue (100),
 										MakeUintegerAccessor (&FleeRouting::m_distanceToSink),
 										MakeUintegerChecker<uint8_t> ())
+    .AddAttribute ("HelloInterval",
+                   "Interval between two hello messages of a sink",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&FleeRouting::m_helloInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("RefreshInterval",
+                   "Shortest interval between two hello messages of the other nodes with a path to the sink, "
+                   "used after their path ETX changed and doubled while it stays stable. Every hello is a "
+                   "broadcast the FLEE MAC repeats on up to 16 channels, so N nodes refreshing every T seconds "
+                   "send about 16 N / T frames per second",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&FleeRouting::m_minRefreshInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxRefreshInterval",
+                   "Longest interval between two hello messages of the other nodes with a path to the sink, "
+                   "it bounds the time a child needs to notice a slow drift of the path ETX",
+                   TimeValue (Seconds (64)),
+                   MakeTimeAccessor (&FleeRouting::m_maxRefreshInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MultiParent",
+                   "Keep all neighbours with a near minimal path ETX as parents and spread the flows over them",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&FleeRouting::m_multiParent),
+                   MakeBooleanChecker ())
+    .AddAttribute ("EtxTolerance",
+                   "Parents whose path ETX is within this margin of the best one share the load",
+                   DoubleValue (0.5),
+                   MakeDoubleAccessor (&FleeRouting::m_etxTolerance),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("AggregationDelay",
+                   "Time a forwarded UDP reading may wait to be merged with others to the same destination (0 disables aggregation)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&FleeRouting::m_aggregationDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("RegistrationInterval",
+                   "Interval between two registrations of a node with its parent, which build the routes down the tree (0 disables them)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&FleeRouting::m_registrationInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("AggregationMaxSize",
+                   "Maximum payload of an aggregate in bytes, the default fills a 127 byte frame "
+                   "after the MAC header, a 6LoWPAN header with both prefixes inline and the UDP header",
+                   UintegerValue (88),
+                   MakeUintegerAccessor (&FleeRouting::m_aggregationMaxSize),
+                   MakeUintegerChecker<uint32_t> (AGGREGATE_RECORD_HEADER + 1))
   ;
   return tid;
 }
@@ -72,8 +188,13 @@ FleeRouting::FleeRouting ()
 
 void FleeRouting::DoInitialize (void)
 {
+	m_pathEtx = (m_distanceToSink == 0) ? 0 : FLEE_NO_PATH_ETX;
+	m_refreshInterval = m_minRefreshInterval;
 	if (m_distanceToSink == 0)
 		Simulator::ScheduleNow ( &FleeRouting::Hello, this);
+	else if (!m_registrationInterval.IsZero ())
+		m_registrationEvent = Simulator::Schedule (Seconds (m_registrationInterval.GetSeconds () * m_var->GetValue ()),
+		                                           &FleeRouting::Register, this, false);
 }
 
 
@@ -166,6 +287,125 @@ FleeRouting::PrintRoutingTable (Ptr<OutputStreamWrapper> stream) const
 	//std::cout << std::endl;
 }
 
+uint8_t
+FleeRouting::GetDistanceToSink (void) const
+{
+  return m_distanceToSink;
+}
+
+double
+FleeRouting::GetPathEtx (void) const
+{
+  return m_pathEtx;
+}
+
+void
+FleeRouting::SaveState (std::ostream &os) const
+{
+  WriteState<uint8_t> (os, m_distanceToSink);
+  WriteState<double> (os, m_pathEtx);
+  WriteState<uint32_t> (os, m_parents.size ());
+  for (std::map<Ipv6Address, uint32_t>::const_iterator it = m_parents.begin (); it != m_parents.end (); ++it)
+    {
+      uint8_t buf[16];
+      it->first.GetBytes (buf);
+      os.write ((const char *) buf, 16);
+      WriteState<uint32_t> (os, it->second);
+      std::map<Ipv6Address, double>::const_iterator etx = m_parentEtx.find (it->first);
+      WriteState<double> (os, etx == m_parentEtx.end () ? 0.0 : etx->second);
+    }
+  WriteState<uint32_t> (os, GetNDownwardRoutes ());
+  for (std::map<Ipv6Address, DownwardRoute>::const_iterator it = m_downward.begin (); it != m_downward.end (); ++it)
+    {
+      if (IsExpired (it->second))
+        {
+          continue;
+        }
+      uint8_t buf[16];
+      it->first.GetBytes (buf);
+      os.write ((const char *) buf, 16);
+      it->second.nextHop.GetBytes (buf);
+      os.write ((const char *) buf, 16);
+      WriteState<uint32_t> (os, it->second.interface);
+      WriteState<int64_t> (os, (Simulator::Now () - it->second.refreshed).GetNanoSeconds ());
+    }
+}
+
+void
+FleeRouting::RestoreState (std::istream &is)
+{
+  NS_LOG_FUNCTION (this);
+  m_distanceToSink = ReadState<uint8_t> (is);
+  m_pathEtx = ReadState<double> (is);
+  m_parents.clear ();
+  m_parentEtx.clear ();
+  uint32_t n = ReadState<uint32_t> (is);
+  for (uint32_t i = 0; i < n && is; i++)
+    {
+      uint8_t buf[16];
+      is.read ((char *) buf, 16);
+      Ipv6Address parent (buf);
+      uint32_t interface = ReadState<uint32_t> (is);
+      m_parentEtx[parent] = ReadState<double> (is);
+      m_parents[parent] = interface;
+      if (!HasNetworkDest (parent, interface))
+        {
+          AddHostRouteTo (parent, parent, interface);
+        }
+    }
+  m_downward.clear ();
+  n = ReadState<uint32_t> (is);
+  for (uint32_t i = 0; i < n && is; i++)
+    {
+      uint8_t buf[16];
+      is.read ((char *) buf, 16);
+      Ipv6Address target (buf);
+      is.read ((char *) buf, 16);
+      DownwardRoute &route = m_downward[target];
+      route.nextHop = Ipv6Address (buf);
+      route.interface = ReadState<uint32_t> (is);
+      route.refreshed = Simulator::Now () - NanoSeconds (ReadState<int64_t> (is));
+    }
+  // the children learnt this path ETX before the checkpoint, keep repeating it
+  m_advertisedEtx = m_pathEtx;
+  m_refreshInterval = m_minRefreshInterval;
+  if (m_distanceToSink > 0 && !m_parents.empty ())
+    {
+      m_helloEvent.Cancel ();
+      m_helloEvent = Simulator::Schedule (Seconds (m_refreshInterval.GetSeconds () * m_var->GetValue ()),
+                                          &FleeRouting::Hello, this);
+    }
+}
+
+void
+FleeRouting::WriteSnapshot (std::ostream &os, SnapshotFormat format) const
+{
+  int64_t time = Simulator::Now ().GetNanoSeconds ();
+  uint32_t node = m_ipv6->GetObject<Node> ()->GetId ();
+  for (NetworkRoutesCI it = m_networkRoutes.begin (); it != m_networkRoutes.end (); ++it)
+    {
+      const Ipv6RoutingTableEntry *route = it->first;
+      WriteSnapshotRecord (os, format, time, node, route->GetDest (),
+                           route->GetDestNetworkPrefix ().GetPrefixLength (),
+                           route->GetGateway (), it->second, m_distanceToSink);
+    }
+  for (std::map<Ipv6Address, DownwardRoute>::const_iterator it = m_downward.begin (); it != m_downward.end (); ++it)
+    {
+      if (!IsExpired (it->second))
+        {
+          WriteSnapshotRecord (os, format, time, node, it->first, 128, it->second.nextHop, 0, m_distanceToSink);
+        }
+    }
+}
+
+int64_t
+FleeRouting::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_var->SetStream (stream);
+  return 1;
+}
+
 void FleeRouting::AddHostRouteTo (Ipv6Address dst, Ipv6Address nextHop, uint32_t interface, Ipv6Address prefixToUse, uint32_t metric)
 {
   NS_LOG_FUNCTION (this << dst << nextHop << interface << prefixToUse << metric);
@@ -242,6 +482,7 @@ bool FleeRouting::HasNetworkDest (Ipv6Address network, uint32_t interfaceIndex)
 Ptr<Ipv6Route> FleeRouting::LookupStatic (Ipv6Address dst, Ptr<NetDevice> interface)
 {
   NS_LOG_FUNCTION (this << dst << interface);
+  FLEE_PROFILE_ZONE ("FleeRouting::LookupStatic");
   Ptr<Ipv6Route> rtentry = 0;
   uint16_t longestMask = 0;
   uint32_t shortestMetric = 0xffffffff;
@@ -326,6 +567,21 @@ void FleeRouting::DoDispose ()
       delete j->first;
     }
   m_networkRoutes.clear ();
+  m_parents.clear ();
+  m_parentEtx.clear ();
+  m_helloEvent.Cancel ();
+  m_registrationEvent.Cancel ();
+  m_downward.clear ();
+  for (std::map<Ipv6Address, AggregateBuffer>::iterator it = m_aggregates.begin (); it != m_aggregates.end (); ++it)
+    {
+      it->second.flush.Cancel ();
+    }
+  m_aggregates.clear ();
+  if (m_aggregationSocket)
+    {
+      m_aggregationSocket->Close ();
+      m_aggregationSocket = 0;
+    }
 
   m_ipv6 = 0;
   Ipv6RoutingProtocol::DoDispose ();
@@ -460,6 +716,19 @@ Ptr<Ipv6Route> FleeRouting::RouteOutput (Ptr<Packet> p, const Ipv6Header &header
 		
 
   rtentry = LookupStatic (destination, oif);
+  if ((!rtentry || rtentry->GetDestination () != destination) && !destination.IsLinkLocal ())
+    {
+      // not a neighbour, send it down the tree if it registered through us, up otherwise
+      Ptr<Ipv6Route> next = LookupDownward (destination);
+      if (!next)
+        {
+          next = LookupParent (header);
+        }
+      if (next)
+        {
+          rtentry = next;
+        }
+    }
   if (rtentry)
     {
       sockerr = Socket::ERROR_NOTERROR;
@@ -495,6 +764,26 @@ bool FleeRouting::RouteInput (Ptr<const Packet> p, const Ipv6Header &header, Ptr
   // Next, try to find a route
   NS_LOG_LOGIC ("Unicast destination");
   Ptr<Ipv6Route> rtentry = LookupStatic (header.GetDestinationAddress ());
+  if ((!rtentry || rtentry->GetDestination () != dst) && !dst.IsLinkLocal ())
+    {
+      // not a neighbour, forward it down the tree if it registered through us, ...
+      Ptr<Ipv6Route> child = LookupDownward (dst);
+      // ... up the tree otherwise
+      Ptr<Ipv6Route> parent = child ? Ptr<Ipv6Route> (0) : LookupParent (header);
+      if (child)
+        {
+          rtentry = child;
+        }
+      else if (parent)
+        {
+          // merge it with other readings for the same destination if possible
+          if (!m_aggregationDelay.IsZero () && Aggregate (p, header))
+            {
+              return true;
+            }
+          rtentry = parent;
+        }
+    }
 
   if (rtentry != 0)
     {
@@ -518,6 +807,17 @@ void FleeRouting::NotifyInterfaceUp (uint32_t i)
   if (iface.GetAddress () == Ipv6Address ("::1"))
     return;
 
+  // one socket per node receives the aggregates for this node
+  if (!m_aggregationSocket)
+    {
+      m_aggregationSocket = Socket::CreateSocket (m_ipv6->GetObject <Node> (),
+                                                  UdpSocketFactory::GetTypeId ());
+      NS_ASSERT (m_aggregationSocket != 0);
+      m_aggregationSocket->SetRecvCallback (MakeCallback (&FleeRouting::RecvAggregate, this));
+      m_aggregationSocket->SetRecvPktInfo (true);
+      m_aggregationSocket->Bind (Inet6SocketAddress (Ipv6Address::GetAny (), FLEE_AGGREGATION_PORT));
+    }
+
   // Create a socket to listen only on this interface
   Ptr<Socket> socket = Socket::CreateSocket (m_ipv6->GetObject <Node> (), 
                                              UdpSocketFactory::GetTypeId ());
@@ -663,51 +963,557 @@ FleeRouting::Hello (void)
   for (std::map<Ptr<Socket>, Ipv6InterfaceAddress>::const_iterator j =
          m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
 	{
-		uint8_t payload[1];
+		// distance and path ETX in tenths
+		uint16_t etx = (uint16_t) std::min (m_pathEtx * 10 + 0.5, (double) 0xffff);
+		uint8_t payload[5];
 		payload[0] = m_distanceToSink;
-		Ptr<Packet> pkt = Create<Packet> (payload,1);
+		payload[1] = etx >> 8;
+		payload[2] = etx & 0xff;
+		// a radio of a sink with several tells which children it serves
+		Ptr<LrWpanFleeMac> mac = GetFleeMac (m_ipv6->GetInterfaceForDevice (j->first->GetBoundNetDevice ()));
+		uint8_t size = 3;
+		if (mac && mac->GetNSinkRadios () > 1)
+		{
+			payload[3] = mac->GetSinkRadio ();
+			payload[4] = mac->GetNSinkRadios ();
+			size = 5;
+		}
+		Ptr<Packet> pkt = Create<Packet> (payload,size);
+		MarkControl (pkt);
 		Ipv6Address destination = j->second.GetAddress ();
 		destination = Ipv6Address ("ff02::1");
 		j->first->SendTo(pkt,0,Inet6SocketAddress(destination,FLEE_PORT));
 	}
+	// a path ETX that moved starts the refresh over from the shortest interval
+	if (std::fabs (m_pathEtx - m_advertisedEtx) > m_etxTolerance)
+		m_refreshInterval = m_minRefreshInterval;
+	m_advertisedEtx = m_pathEtx;
 	if (m_distanceToSink == 0)
-		Simulator::Schedule (Simulator::Now(), &FleeRouting::Hello, this);
+		m_helloEvent = Simulator::Schedule (m_helloInterval, &FleeRouting::Hello, this);
+	// the others repeat their path ETX while they have one, so the ETX of their links reaches the children,
+	// and back off while it stays the same
+	else if (!m_parents.empty ())
+	{
+		m_helloEvent = Simulator::Schedule (Seconds (m_refreshInterval.GetSeconds () * (0.75 + 0.5 * m_var->GetValue ())),
+		                                    &FleeRouting::Hello, this);
+		m_refreshInterval = std::min (m_refreshInterval + m_refreshInterval, m_maxRefreshInterval);
+	}
+}
+
+void
+FleeRouting::AdvertisePathEtx (bool force)
+{
+	// only a change beyond the tolerance is worth a hello before the periodic one
+	if (!force && std::fabs (m_pathEtx - m_advertisedEtx) <= m_etxTolerance)
+		return;
+	// once for a burst of changes
+	if (m_helloEvent.IsRunning () && Simulator::GetDelayLeft (m_helloEvent) <= MilliSeconds (100))
+		return;
+	NS_LOG_DEBUG ("Rebroadcast hello message");
+	m_refreshInterval = m_minRefreshInterval;
+	m_helloEvent.Cancel ();
+	m_helloEvent = Simulator::Schedule (MilliSeconds (100),&FleeRouting::Hello, this);
 }
 
 void 
 FleeRouting::RecvFlee (Ptr<Socket> socket)
 {
+	FLEE_PROFILE_ZONE ("FleeRouting::RecvFlee");
 	Ptr<Packet> pkt;
 	Address address;
 	// Read all messages from the current socket
 	while (pkt = socket->RecvFrom(address))
 	{
-		if (pkt->GetSize()==1)
+		if ((pkt->GetSize()==3 || pkt->GetSize()==5) && m_distanceToSink > 0 && Inet6SocketAddress::IsMatchingType (address))
 		{
-			uint8_t payload[1];
-			pkt->CopyData(payload,1);
-			NS_LOG_DEBUG ("We can see a device " << (uint32_t)payload[0] << "hops away from the sink");
-			if (payload[0]+1<m_distanceToSink)
+			uint8_t payload[5];
+			pkt->CopyData(payload,pkt->GetSize ());
+			double advertised = ((payload[1] << 8) | payload[2]) / 10.0;
+			Ipv6Address add = Inet6SocketAddress::ConvertFrom (address).GetIpv6 ();
+			uint32_t interface = m_ipv6->GetInterfaceForDevice (socket->GetBoundNetDevice ());
+			// another radio of the sink serves us, this one does not set up a link to us
+			Ptr<LrWpanFleeMac> mac = GetFleeMac (interface);
+			if (pkt->GetSize () == 5 && payload[4] > 1 && mac
+					&& LrWpanFleeMac::GetSinkRadioFor (mac->GetShortAddress (), payload[4]) != payload[3])
+				continue;
+			NS_LOG_DEBUG ("We can see a device " << (uint32_t)payload[0] << " hops and " << advertised << " ETX away from the sink");
+			if (m_parents.find (add) != m_parents.end ())
+			{
+				// a parent that lost its path, or that is no closer to the sink than us, may route through us
+				if (advertised >= FLEE_NO_PATH_ETX || advertised >= m_advertisedEtx)
+				{
+					NS_LOG_DEBUG ("Dropping parent " << add << " advertising " << advertised);
+					m_parents.erase (add);
+					m_parentEtx.erase (add);
+					if (m_parents.empty ())
+						m_pathEtx = FLEE_NO_PATH_ETX;
+				}
+				else
+					m_parentEtx[add] = advertised;
+				// our links may have changed since the last hello as well
+				UpdatePathEtx ();
+				AdvertisePathEtx (false);
+				CheckRegisteredParent ();
+				continue;
+			}
+			// nor can a neighbour that is no closer to the sink than we told our children, until they heard we lost our path
+			if (advertised >= FLEE_NO_PATH_ETX || advertised >= m_advertisedEtx)
+				continue;
+			// our links may have changed since the last hello
+			UpdatePathEtx ();
+			double cost = advertised + GetLinkEtx (add, interface);
+			if (m_parents.empty () || cost < m_pathEtx - m_etxTolerance)
+			{
+				m_pathEtx = cost;
+				m_distanceToSink = payload[0]+1;
+				// the old parents are worse than this one
+				m_parents.clear ();
+				m_parentEtx.clear ();
+				m_parentEtx[add] = advertised;
+				// if we do not have a route yet, add the address to our list, ...
+				if (AddParent (socket, add))
+				{
+					// ... and send a message back to finalize.
+					Simulator::ScheduleNow (&FleeRouting::SendHelloResp,this,socket,Create<Packet> (9), 0, Inet6SocketAddress (add,FLEE_PORT));
+				}
+				CheckRegisteredParent ();
+				// Broadcast the new path cost, once for a burst of better hellos.
+				AdvertisePathEtx (true);
+			}
+			else if (m_multiParent && cost <= m_pathEtx + m_etxTolerance)
 			{
-				m_distanceToSink = std::min ((uint8_t)(payload[0]+1),m_distanceToSink);
-				// check if the address is a ipv6 socket address
-				if (Inet6SocketAddress::IsMatchingType (address))
+				// an equally good parent, share the load with it
+				m_parentEtx[add] = advertised;
+				if (AddParent (socket, add))
 				{
-					// convert it and get IPv6 address
-					Ipv6Address add = Inet6SocketAddress::ConvertFrom (address).GetIpv6 ();
-					// if we do not have a route yet, ...
-					if (!HasNetworkDest (add, m_ipv6->GetInterfaceForDevice(socket->GetBoundNetDevice ())))
-					{
-						// ... add the address to our list, ...
-						AddHostRouteTo (add, add, m_ipv6->GetInterfaceForDevice (socket->GetBoundNetDevice ())); 
-						// ... and send a message back to finalize.
-						Simulator::ScheduleNow (&FleeRouting::SendHelloResp,this,socket,Create<Packet> (9), 0, Inet6SocketAddress (add,FLEE_PORT));
-						// Broadcast the new message.
-						NS_LOG_DEBUG ("Rebroadcast hello message");
-						Simulator::Schedule (MilliSeconds (100),&FleeRouting::Hello, this);
-					}
+					NS_LOG_DEBUG ("Additional parent " << add);
+					Simulator::ScheduleNow (&FleeRouting::SendHelloResp,this,socket,Create<Packet> (9), 0, Inet6SocketAddress (add,FLEE_PORT));
 				}
+				m_pathEtx = std::min (m_pathEtx, cost);
+				m_distanceToSink = std::min ((uint8_t)(payload[0]+1), m_distanceToSink);
+				AdvertisePathEtx (false);
+				CheckRegisteredParent ();
+			}
+		}
+		else if (pkt->GetSize()==17 && Inet6SocketAddress::IsMatchingType (address))
+		{
+			uint8_t payload[17];
+			pkt->CopyData(payload,17);
+			if (payload[0] != FLEE_REGISTRATION)
+				continue;
+			Ipv6Address target (payload + 1);
+			Ipv6Address child = Inet6SocketAddress::ConvertFrom (address).GetIpv6 ();
+			// a parent cannot be below us, and neither can we
+			if (m_parents.find (child) != m_parents.end () || m_ipv6->GetInterfaceForAddress (target) >= 0)
+				continue;
+			NS_LOG_DEBUG ("Node " << target << " can be reached through " << child);
+			DownwardRoute &route = m_downward[target];
+			route.nextHop = child;
+			route.interface = m_ipv6->GetInterfaceForDevice (socket->GetBoundNetDevice ());
+			route.refreshed = Simulator::Now ();
+			// pass it on, up to the sink
+			if (m_distanceToSink > 0)
+				SendRegistration (target);
+		}
+	}
+}
+
+void
+FleeRouting::UpdatePathEtx (void)
+{
+	if (m_parents.empty ())
+		return;
+	double best = FLEE_NO_PATH_ETX;
+	for (std::map<Ipv6Address, uint32_t>::const_iterator it = m_parents.begin (); it != m_parents.end (); ++it)
+		best = std::min (best, m_parentEtx[it->first] + GetLinkEtx (it->first, it->second));
+	m_pathEtx = best;
+	// parents that fell out of the tolerance no longer get flows
+	for (std::map<Ipv6Address, uint32_t>::iterator it = m_parents.begin (); it != m_parents.end (); )
+	{
+		if (m_parentEtx[it->first] + GetLinkEtx (it->first, it->second) > best + m_etxTolerance)
+		{
+			NS_LOG_DEBUG ("Dropping parent " << it->first);
+			m_parentEtx.erase (it->first);
+			m_parents.erase (it++);
+		}
+		else
+			++it;
+	}
+}
+
+bool
+FleeRouting::AddParent (Ptr<Socket> socket, Ipv6Address parent)
+{
+	uint32_t interface = m_ipv6->GetInterfaceForDevice (socket->GetBoundNetDevice ());
+	m_parents[parent] = interface;
+	// a former child that became a parent no longer leads down the tree
+	for (std::map<Ipv6Address, DownwardRoute>::iterator it = m_downward.begin (); it != m_downward.end (); )
+	{
+		if (it->second.nextHop == parent)
+			m_downward.erase (it++);
+		else
+			++it;
+	}
+	if (HasNetworkDest (parent, interface))
+		return false;
+	AddHostRouteTo (parent, parent, interface);
+	return true;
+}
+
+Ptr<Ipv6Route>
+FleeRouting::LookupParent (const Ipv6Header &header)
+{
+	if (m_parents.empty ())
+		return 0;
+
+	// hash the flow, so all packets of a flow take the same parent
+	uint8_t buf[16];
+	uint32_t hash = 2166136261U;
+	header.GetSourceAddress ().GetBytes (buf);
+	for (uint8_t i = 0; i < 16; i++)
+		hash = (hash ^ buf[i]) * 16777619U;
+	header.GetDestinationAddress ().GetBytes (buf);
+	for (uint8_t i = 0; i < 16; i++)
+		hash = (hash ^ buf[i]) * 16777619U;
+	hash = (hash ^ header.GetFlowLabel ()) * 16777619U;
+
+	// spread the flows in proportion to the weight of the parents
+	std::vector<std::pair<double, std::map<Ipv6Address, uint32_t>::const_iterator> > weights;
+	double total = 0;
+	for (std::map<Ipv6Address, uint32_t>::const_iterator it = m_parents.begin (); it != m_parents.end (); ++it)
+	{
+		total += GetParentWeight (it->first, it->second);
+		weights.push_back (std::make_pair (total, it));
+	}
+	double point = hash / 4294967296.0 * total;
+	std::map<Ipv6Address, uint32_t>::const_iterator parent = weights.back ().second;
+	for (uint32_t i = 0; i < weights.size (); i++)
+		if (point < weights[i].first)
+		{
+			parent = weights[i].second;
+			break;
+		}
+
+	Ptr<Ipv6Route> rtentry = Create<Ipv6Route> ();
+	rtentry->SetDestination (header.GetDestinationAddress ());
+	rtentry->SetGateway (parent->first);
+	rtentry->SetOutputDevice (m_ipv6->GetNetDevice (parent->second));
+	rtentry->SetSource (m_ipv6->SourceAddressSelection (parent->second, header.GetDestinationAddress ()));
+	NS_LOG_LOGIC ("Flow to " << header.GetDestinationAddress () << " via parent " << parent->first);
+	return rtentry;
+}
+
+double
+FleeRouting::GetParentWeight (Ipv6Address parent, uint32_t interface) const
+{
+	// the fewer transmissions a packet needs to reach the sink, the more flows
+	double pathEtx = GetLinkEtx (parent, interface);
+	std::map<Ipv6Address, double>::const_iterator it = m_parentEtx.find (parent);
+	if (it != m_parentEtx.end ())
+		pathEtx += it->second;
+	return 1.0 / pathEtx;
+}
+
+double
+FleeRouting::GetLinkEtx (Ipv6Address neighbour, uint32_t interface) const
+{
+	Ptr<LrWpanFleeMac> mac = GetFleeMac (interface);
+	if (!mac)
+		return 1.0;
+	// the link-local address of a 6LoWPAN node ends in its short address
+	uint8_t buf[16];
+	neighbour.GetBytes (buf);
+	Mac16Address shortAddress;
+	shortAddress.CopyFrom (buf + 14);
+	return mac->GetLinkEtx (shortAddress);
+}
+
+Ptr<LrWpanFleeMac>
+FleeRouting::GetFleeMac (uint32_t interface) const
+{
+	Ptr<NetDevice> device = m_ipv6->GetNetDevice (interface);
+	Ptr<SixLowPanNetDevice> sixlowpan = DynamicCast<SixLowPanNetDevice> (device);
+	if (sixlowpan)
+		device = sixlowpan->GetNetDevice ();
+	Ptr<LrWpanNetDevice> lrwpan = DynamicCast<LrWpanNetDevice> (device);
+	if (!lrwpan)
+		return 0;
+	return DynamicCast<LrWpanFleeMac> (lrwpan->GetMac ());
+}
+
+std::map<Ipv6Address, uint32_t>
+FleeRouting::GetParents (void) const
+{
+	return m_parents;
+}
+
+uint32_t
+FleeRouting::GetNDownwardRoutes (void) const
+{
+	uint32_t n = 0;
+	for (std::map<Ipv6Address, DownwardRoute>::const_iterator it = m_downward.begin (); it != m_downward.end (); ++it)
+		if (!IsExpired (it->second))
+			n++;
+	return n;
+}
+
+bool
+FleeRouting::IsExpired (const DownwardRoute &route) const
+{
+	return Simulator::Now () - route.refreshed > Seconds (m_registrationInterval.GetSeconds () * FLEE_REGISTRATION_LIFETIME);
+}
+
+std::map<Ipv6Address, uint32_t>::const_iterator
+FleeRouting::GetBestParent (void) const
+{
+	std::map<Ipv6Address, uint32_t>::const_iterator parent = m_parents.begin ();
+	for (std::map<Ipv6Address, uint32_t>::const_iterator it = m_parents.begin (); it != m_parents.end (); ++it)
+		if (GetParentWeight (it->first, it->second) > GetParentWeight (parent->first, parent->second))
+			parent = it;
+	return parent;
+}
+
+void
+FleeRouting::CheckRegisteredParent (void)
+{
+	if (m_registrationInterval.IsZero () || m_parents.empty () || GetBestParent ()->first == m_registeredParent)
+		return;
+	// the nodes above the new best parent do not know our subtree yet
+	m_registeredParent = GetBestParent ()->first;
+	Simulator::ScheduleNow (&FleeRouting::Register, this, true);
+}
+
+void
+FleeRouting::Register (bool subtree)
+{
+	NS_LOG_FUNCTION (this << subtree);
+	if (m_registrationInterval.IsZero () || m_distanceToSink == 0)
+		return;
+	for (uint32_t i = 0; i < m_ipv6->GetNInterfaces (); i++)
+		for (uint32_t j = 0; j < m_ipv6->GetNAddresses (i); j++)
+			if (m_ipv6->GetAddress (i, j).GetScope () == Ipv6InterfaceAddress::GLOBAL)
+				SendRegistration (m_ipv6->GetAddress (i, j).GetAddress ());
+	// the nodes that stopped registering are gone from the subtree
+	for (std::map<Ipv6Address, DownwardRoute>::iterator it = m_downward.begin (); it != m_downward.end (); )
+	{
+		if (IsExpired (it->second))
+			m_downward.erase (it++);
+		else
+			++it;
+	}
+	if (subtree)
+		for (std::map<Ipv6Address, DownwardRoute>::const_iterator it = m_downward.begin (); it != m_downward.end (); ++it)
+			SendRegistration (it->first);
+	if (!m_parents.empty ())
+		m_registeredParent = GetBestParent ()->first;
+	// refresh the routes before the ones of a moved node go stale, jittered so the nodes do not register at once
+	m_registrationEvent.Cancel ();
+	m_registrationEvent = Simulator::Schedule (Seconds (m_registrationInterval.GetSeconds () * (0.75 + 0.5 * m_var->GetValue ())),
+	                                           &FleeRouting::Register, this, false);
+}
+
+void
+FleeRouting::SendRegistration (Ipv6Address target)
+{
+	if (m_parents.empty ())
+		return;
+	// only to the best parent, a copy per parent would multiply on every hop
+	std::map<Ipv6Address, uint32_t>::const_iterator parent = GetBestParent ();
+
+	uint8_t payload[17];
+	payload[0] = FLEE_REGISTRATION;
+	target.GetBytes (payload + 1);
+	for (std::map<Ptr<Socket>, Ipv6InterfaceAddress>::const_iterator j =
+			m_socketAddresses.begin (); j != m_socketAddresses.end (); ++j)
+	{
+		if (m_ipv6->GetInterfaceForDevice (j->first->GetBoundNetDevice ()) == (int32_t) parent->second)
+		{
+			Ptr<Packet> pkt = Create<Packet> (payload, 17);
+			MarkControl (pkt);
+			j->first->SendTo (pkt, 0, Inet6SocketAddress (parent->first, FLEE_PORT));
+			NS_LOG_DEBUG ("Registering " << target << " with " << parent->first);
+			return;
+		}
+	}
+}
+
+Ptr<Ipv6Route>
+FleeRouting::LookupDownward (Ipv6Address dest)
+{
+	std::map<Ipv6Address, DownwardRoute>::iterator it = m_downward.find (dest);
+	if (it == m_downward.end ())
+		return 0;
+	if (IsExpired (it->second))
+	{
+		NS_LOG_LOGIC ("Route to " << dest << " down the tree expired");
+		m_downward.erase (it);
+		return 0;
+	}
+	Ptr<Ipv6Route> rtentry = Create<Ipv6Route> ();
+	rtentry->SetDestination (dest);
+	rtentry->SetGateway (it->second.nextHop);
+	rtentry->SetOutputDevice (m_ipv6->GetNetDevice (it->second.interface));
+	rtentry->SetSource (m_ipv6->SourceAddressSelection (it->second.interface, dest));
+	NS_LOG_LOGIC ("Route to " << dest << " down the tree via " << it->second.nextHop);
+	return rtentry;
+}
+
+bool
+FleeRouting::Aggregate (Ptr<const Packet> p, const Ipv6Header &header)
+{
+	if (header.GetNextHeader () != UdpL4Protocol::PROT_NUMBER)
+		return false;
+	Ipv6Address destination = header.GetDestinationAddress ();
+	UdpHeader udp;
+	p->PeekHeader (udp);
+	if (udp.GetDestinationPort () == FLEE_AGGREGATION_PORT)
+	{
+		// merge the readings of an aggregate from further down the tree
+		Ptr<Packet> copy = p->Copy ();
+		copy->RemoveHeader (udp);
+		std::vector<uint8_t> data (copy->GetSize ());
+		if (data.empty ())
+			return true;
+		copy->CopyData (&data[0], data.size ());
+		uint32_t offset = 0;
+		while (offset + AGGREGATE_RECORD_HEADER <= data.size ())
+		{
+			uint8_t length = data[offset + 13];
+			if (offset + AGGREGATE_RECORD_HEADER + length > data.size ())
+				break;
+			// this hop counts for every reading, like it would when forwarded alone
+			if (data[offset + 8] > 1)
+				AddRecord (destination, &data[offset], data[offset + 8] - 1,
+				           (data[offset + 9] << 8) | data[offset + 10], (data[offset + 11] << 8) | data[offset + 12],
+				           &data[offset + AGGREGATE_RECORD_HEADER], length);
+			else
+				NS_LOG_LOGIC ("Dropping an aggregated reading whose hop limit expired");
+			offset += AGGREGATE_RECORD_HEADER + length;
+		}
+		return true;
+	}
+	// the expiry of the hop limit is left to the normal forwarding
+	if (header.GetHopLimit () <= 1)
+		return false;
+	uint32_t length = p->GetSize () - udp.GetSerializedSize ();
+	if (length > 0xff || length + AGGREGATE_RECORD_HEADER > m_aggregationMaxSize)
+		return false;
+	// only the interface identifier of the source is kept, the destination restores its prefix
+	uint8_t source[16];
+	uint8_t prefix[16];
+	header.GetSourceAddress ().GetBytes (source);
+	destination.GetBytes (prefix);
+	if (!std::equal (source, source + 8, prefix))
+		return false;
+
+	std::vector<uint8_t> data (length);
+	Ptr<Packet> copy = p->Copy ();
+	copy->RemoveHeader (udp);
+	if (length > 0)
+		copy->CopyData (&data[0], length);
+	AddRecord (destination, source + 8, header.GetHopLimit () - 1, udp.GetSourcePort (), udp.GetDestinationPort (),
+	           data.empty () ? 0 : &data[0], length);
+	return true;
+}
+
+void
+FleeRouting::AddRecord (Ipv6Address destination, const uint8_t *iid, uint8_t hopLimit,
+                        uint16_t sourcePort, uint16_t destinationPort, const uint8_t *data, uint8_t length)
+{
+	AggregateBuffer &buffer = m_aggregates[destination];
+	// make room if this reading does not fit anymore
+	if (!buffer.records.empty () && buffer.records.size () + AGGREGATE_RECORD_HEADER + length > m_aggregationMaxSize)
+		FlushAggregate (destination);
+
+	buffer.records.insert (buffer.records.end (), iid, iid + 8);
+	buffer.records.push_back (hopLimit);
+	buffer.records.push_back (sourcePort >> 8);
+	buffer.records.push_back (sourcePort & 0xff);
+	buffer.records.push_back (destinationPort >> 8);
+	buffer.records.push_back (destinationPort & 0xff);
+	buffer.records.push_back (length);
+	buffer.records.insert (buffer.records.end (), data, data + length);
+	NS_LOG_LOGIC ("Aggregate to " << destination << " holds " << buffer.records.size () << " bytes");
+
+	if (buffer.records.size () + AGGREGATE_RECORD_HEADER >= m_aggregationMaxSize)
+		FlushAggregate (destination);
+	else if (!buffer.flush.IsRunning ())
+		buffer.flush = Simulator::Schedule (m_aggregationDelay, &FleeRouting::FlushAggregate, this, destination);
+}
+
+void
+FleeRouting::FlushAggregate (Ipv6Address destination)
+{
+	std::map<Ipv6Address, AggregateBuffer>::iterator it = m_aggregates.find (destination);
+	if (it == m_aggregates.end () || it->second.records.empty ())
+		return;
+	it->second.flush.Cancel ();
+	Ptr<Packet> pkt = Create<Packet> (&it->second.records[0], it->second.records.size ());
+	it->second.records.clear ();
+	NS_LOG_DEBUG ("Sending aggregate of " << pkt->GetSize () << " bytes to " << destination);
+	m_aggregationSocket->SendTo (pkt, 0, Inet6SocketAddress (destination, FLEE_AGGREGATION_PORT));
+}
+
+void
+FleeRouting::RecvAggregate (Ptr<Socket> socket)
+{
+	Ptr<Packet> pkt;
+	Address from;
+	Ptr<Ipv6L3Protocol> l3 = m_ipv6->GetObject<Ipv6L3Protocol> ();
+	while ((pkt = socket->RecvFrom (from)))
+	{
+		Ipv6PacketInfoTag info;
+		if (!pkt->RemovePacketTag (info))
+			continue;
+		Ptr<NetDevice> device = m_ipv6->GetObject<Node> ()->GetDevice (info.GetRecvIf ());
+		// the aggregate was sent to the global address of the receiving interface
+		int32_t interface = m_ipv6->GetInterfaceForDevice (device);
+		if (interface < 0)
+			continue;
+		Ipv6Address destination;
+		for (uint32_t i = 0; i < m_ipv6->GetNAddresses (interface); i++)
+			if (m_ipv6->GetAddress (interface, i).GetScope () == Ipv6InterfaceAddress::GLOBAL)
+			{
+				destination = m_ipv6->GetAddress (interface, i).GetAddress ();
+				break;
+			}
+		std::vector<uint8_t> data (pkt->GetSize ());
+		if (data.empty ())
+			continue;
+		pkt->CopyData (&data[0], data.size ());
+
+		// hand every reading to the stack as if it arrived on its own
+		uint32_t offset = 0;
+		while (offset + AGGREGATE_RECORD_HEADER <= data.size ())
+		{
+			uint8_t length = data[offset + 13];
+			if (offset + AGGREGATE_RECORD_HEADER + length > data.size ())
+				break;
+			// the source shares the prefix of the destination
+			uint8_t address[16];
+			destination.GetBytes (address);
+			std::copy (&data[offset], &data[offset + 8], address + 8);
+			Ipv6Address source (address);
+
+			Ptr<Packet> reading = Create<Packet> (&data[offset + AGGREGATE_RECORD_HEADER], length);
+			UdpHeader udp;
+			udp.SetSourcePort ((data[offset + 9] << 8) | data[offset + 10]);
+			udp.SetDestinationPort ((data[offset + 11] << 8) | data[offset + 12]);
+			if (Node::ChecksumEnabled ())
+			{
+				udp.EnableChecksums ();
+				udp.InitializeChecksum (source, destination, UdpL4Protocol::PROT_NUMBER);
 			}
+			reading->AddHeader (udp);
+			Ipv6Header header;
+			header.SetSourceAddress (source);
+			header.SetDestinationAddress (destination);
+			header.SetNextHeader (UdpL4Protocol::PROT_NUMBER);
+			header.SetPayloadLength (reading->GetSize ());
+			header.SetHopLimit (data[offset + 8]);
+			reading->AddHeader (header);
+			l3->Receive (device, reading, Ipv6L3Protocol::PROT_NUMBER, device->GetAddress (), device->GetAddress (), NetDevice::PACKET_HOST);
+			offset += AGGREGATE_RECORD_HEADER + length;
 		}
 	}
 }
@@ -720,6 +1526,7 @@ FleeRouting::SendHelloResp (Ptr<Socket> socket, Ptr<Packet> pkt, uint8_t flags,
 	{
 		if (socket->GetBoundNetDevice() == j->first->GetBoundNetDevice ())
 		{
+			MarkControl (pkt);
 			j->first->SendTo (pkt,flags,address);
 			NS_LOG_DEBUG("Sending Response");
 		}
@@ -24,6 +24,9 @@
 #include <stdint.h>
 
 #include <list>
+#include <map>
+#include <vector>
+#include <iosfwd>
 
 #include "ns3/ptr.h"
 #include "ns3/ipv6-address.h"
@@ -31,6 +34,8 @@
 #include "ns3/ipv6-header.h"
 #include "ns3/ipv6-routing-protocol.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
 
 namespace ns3 {
 
@@ -40,6 +45,7 @@ class Ipv6Interface;
 class Ipv6Route;
 class Node;
 class Ipv6RoutingTableEntry;
+class LrWpanFleeMac;
 
 /**
  * \ingroup internet
@@ -206,6 +212,89 @@ public:
    */
   virtual void PrintRoutingTable (Ptr<OutputStreamWrapper> stream) const;
 
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by this model.  Return the number of streams (possibly zero) that
+   * have been assigned.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this model
+   */
+  int64_t AssignStreams (int64_t stream);
+
+  /**
+   * \brief Get the number of hops to the sink.
+   * \return the distance to the sink, 0 for a sink, the Sink attribute if
+   * no sink has been heard yet
+   */
+  uint8_t GetDistanceToSink (void) const;
+
+  /**
+   * \brief Get the expected number of transmissions to the sink.
+   *
+   * This is the path ETX of the best parent plus the ETX of the link to it,
+   * as measured by the FLEE MAC.
+   * \return the path ETX, 0 for a sink, 6553.5 if no sink has been heard yet
+   */
+  double GetPathEtx (void) const;
+
+  /**
+   * \brief Get the parents towards the sink.
+   *
+   * With MultiParent enabled, all neighbours whose path ETX is within
+   * EtxTolerance of the best one are kept, otherwise only the best one.
+   * \return the link-local address of every parent with its interface
+   */
+  std::map<Ipv6Address, uint32_t> GetParents (void) const;
+
+  /**
+   * \brief Get the number of nodes below this one that registered through it.
+   *
+   * Packets for these nodes are sent down the tree instead of up.  The table
+   * is only filled when RegistrationInterval is not zero, and a route expires
+   * when the node did not register again for three intervals.
+   * \return the number of downward routes that did not expire
+   */
+  uint32_t GetNDownwardRoutes (void) const;
+
+  /**
+   * \brief Write the distance, the path ETX, the parents and the downward
+   * routes to a checkpoint.
+   * \param os the stream to write to
+   */
+  void SaveState (std::ostream &os) const;
+
+  /**
+   * \brief Replace the distance, the path ETX, the parents and the downward
+   * routes by the ones of a checkpoint, and add the host routes to the parents.
+   * \param is the stream to read from
+   */
+  void RestoreState (std::istream &is);
+
+  /// the encodings of a routing table snapshot
+  enum SnapshotFormat
+  {
+    SNAPSHOT_NDJSON,   //!< one JSON object per line
+    SNAPSHOT_BINARY    //!< fixed-size records in native byte order
+  };
+
+  /**
+   * \brief Write every route as one compact record.
+   *
+   * The downward routes are written as /128 routes with metric 0.
+   * A record holds the time in ns, the node id, the destination, its prefix
+   * length, the next hop, the metric and the distance of the node to the
+   * sink.  An NDJSON record is one line:
+   * {"time":..,"node":..,"dst":"..","prefix":..,"nextHop":"..","metric":..,"distance":..}
+   * A binary record is 50 bytes: int64 time, uint32 node, 16 bytes
+   * destination, uint8 prefix length, 16 bytes next hop, uint32 metric and
+   * uint8 distance.
+   *
+   * \param os the stream to write to
+   * \param format the encoding of the records
+   */
+  void WriteSnapshot (std::ostream &os, SnapshotFormat format) const;
+
 protected:
   /**
    * \brief Dispose this object.
@@ -244,6 +333,39 @@ private:
 	void DoInitialize (void);
 	void RecvFlee (Ptr<Socket> socket);
 	void SendHelloResp (Ptr<Socket> socket, Ptr<Packet> pkt, uint8_t flags, Address address);
+	// add a parent and a host route to it, returns true if the route is new
+	bool AddParent (Ptr<Socket> socket, Ipv6Address parent);
+	// route a packet for a non-neighbour towards one of the parents, picked per flow
+	Ptr<Ipv6Route> LookupParent (const Ipv6Header &header);
+	// relative weight of a parent in the flow distribution
+	double GetParentWeight (Ipv6Address parent, uint32_t interface) const;
+	// ETX of the link to a neighbour, 1 without a FLEE MAC
+	double GetLinkEtx (Ipv6Address neighbour, uint32_t interface) const;
+	// recompute the path ETX from the parents and drop the ones that became too costly
+	void UpdatePathEtx (void);
+	// send a hello soon if forced or if our path ETX moved beyond the tolerance since the last one
+	void AdvertisePathEtx (bool force);
+	// FLEE MAC below an interface, if any
+	Ptr<LrWpanFleeMac> GetFleeMac (uint32_t interface) const;
+	// buffer a UDP packet that is forwarded up the tree, false if it has to be forwarded as is
+	bool Aggregate (Ptr<const Packet> p, const Ipv6Header &header);
+	// append one reading to the aggregate towards a destination
+	void AddRecord (Ipv6Address destination, const uint8_t *iid, uint8_t hopLimit,
+	                uint16_t sourcePort, uint16_t destinationPort, const uint8_t *data, uint8_t length);
+	// send the aggregate towards a destination
+	void FlushAggregate (Ipv6Address destination);
+	// split an aggregate addressed to us and hand every reading to the stack
+	void RecvAggregate (Ptr<Socket> socket);
+	// register our global addresses with the best parent, and the nodes below us if subtree is set
+	void Register (bool subtree);
+	// tell the best parent that a node can be reached through us
+	void SendRegistration (Ipv6Address target);
+	// route a packet for a node below us towards the child it registered through
+	Ptr<Ipv6Route> LookupDownward (Ipv6Address dest);
+	// parent with the highest weight, m_parents must not be empty
+	std::map<Ipv6Address, uint32_t>::const_iterator GetBestParent (void) const;
+	// register the subtree again if another parent became the best one
+	void CheckRegisteredParent (void);
 
 
 	std::map< Ptr<Socket>, Ipv6InterfaceAddress > m_socketAddresses;
@@ -251,8 +373,61 @@ private:
   Ptr<UniformRandomVariable> m_var;
 
 	uint8_t m_distanceToSink=99;
+	// time between two hello messages of the sink
+	Time m_helloInterval;
+	// bounds of the time between two hello messages of the other nodes
+	Time m_minRefreshInterval;
+	Time m_maxRefreshInterval;
+	// time until the next periodic hello of a node other than the sink, doubles while the path ETX is stable
+	Time m_refreshInterval;
+	// next hello message, every node with a path sends one about every refresh interval, and soon after its path ETX changed
+	EventId m_helloEvent;
+	// neighbours with the lowest path ETX, with their interface
+	std::map<Ipv6Address, uint32_t> m_parents;
+	// path ETX advertised by every parent
+	std::map<Ipv6Address, double> m_parentEtx;
+	// expected transmissions to the sink over the best parent
+	double m_pathEtx=0xffff / 10.0;
+	// path ETX in our last hello
+	double m_advertisedEtx=0xffff / 10.0;
+	// parents within this path ETX of the best one are kept
+	double m_etxTolerance;
+	// keep all parents with the minimal path ETX instead of the best one
+	bool m_multiParent;
+
+	// readings waiting to be sent to one destination
+	struct AggregateBuffer
+	{
+		std::vector<uint8_t> records; // source identifier, hop limit, ports, length and payload of every reading
+		EventId flush;                // sends the aggregate when the delay budget is used up
+	};
+	std::map<Ipv6Address, AggregateBuffer> m_aggregates;
+	// socket sending and receiving aggregates
+	Ptr<Socket> m_aggregationSocket;
+	// maximum time a reading waits for others, 0 disables aggregation
+	Time m_aggregationDelay;
+	// maximum payload of an aggregate
+	uint32_t m_aggregationMaxSize;
+
+	// next hop towards a node below us
+	struct DownwardRoute
+	{
+		Ipv6Address nextHop; // link-local address of the child the registration came from
+		uint32_t interface;  // interface of that child
+		Time refreshed;      // last registration of the node
+	};
+	std::map<Ipv6Address, DownwardRoute> m_downward;
+	// whether the node of a downward route stopped registering
+	bool IsExpired (const DownwardRoute &route) const;
+	// time between two registrations of a node, 0 disables downward routes
+	Time m_registrationInterval;
+	// next periodic registration
+	EventId m_registrationEvent;
+	// best parent when we last registered the subtree
+	Ipv6Address m_registeredParent;
 
 	const uint32_t FLEE_PORT = 2017;
+	const uint32_t FLEE_AGGREGATION_PORT = 2018;
 };
 
 } /* namespace ns3 */
@@ -28,10 +28,16 @@
 #include <ns3/mobility-model.h>
 #include <ns3/single-model-spectrum-channel.h>
 #include <ns3/multi-model-spectrum-channel.h>
+#include <ns3/lr-wpan-grid-spectrum-channel.h>
+#include <ns3/lr-wpan-flee-profiler.h>
+#include <ns3/lr-wpan-traffic-source.h>
 #include <ns3/propagation-loss-model.h>
 #include <ns3/propagation-delay-model.h>
 #include <ns3/log.h>
 #include "ns3/names.h"
+#include <ns3/boolean.h>
+#include <ns3/uinteger.h>
+#include <vector>
 
 namespace ns3 {
 
@@ -49,6 +55,7 @@ AsciiLrWpanMacTransmitSinkWithContext (
   std::string context,
   Ptr<const Packet> p)
 {
+  FLEE_PROFILE_ZONE ("LrWpanHelper::AsciiTransmitSink");
   *stream->GetStream () << "t " << Simulator::Now ().GetSeconds () << " " << context << " " << *p << std::endl;
 }
 
@@ -62,6 +69,7 @@ AsciiLrWpanMacTransmitSinkWithoutContext (
   Ptr<OutputStreamWrapper> stream,
   Ptr<const Packet> p)
 {
+  FLEE_PROFILE_ZONE ("LrWpanHelper::AsciiTransmitSink");
   *stream->GetStream () << "t " << Simulator::Now ().GetSeconds () << " " << *p << std::endl;
 }
 
@@ -203,19 +211,49 @@ LrWpanHelper::InstallFlee (NodeContainer c)
       Ptr<Node> node = *i;
 
 			Ptr<LrWpanFleeMac> fleemac = CreateObject<LrWpanFleeMac> ();
-      Ptr<LrWpanCsmaNetDevice> netDevice = CreateObject<LrWpanCsmaNetDevice> ();
-			netDevice->SetMac(fleemac);
-      netDevice->SetChannel (m_channel);
-      node->AddDevice (netDevice);
-      netDevice->SetNode (node);
-			netDevice->GetPhy()->SetPdDataStartNotionCallback (MakeCallback (&LrWpanFleeMac::PdDataStartNotion, fleemac));
       // \todo add the capability to change short address, extended
       // address and panId. Right now they are hardcoded in LrWpanMac::LrWpanMac ()
-      devices.Add (netDevice);
+      devices.Add (InstallFleeDevice (node, fleemac));
     }
   return devices;
 }
 
+NetDeviceContainer
+LrWpanHelper::InstallFleeSink (Ptr<Node> node, uint8_t nRadios)
+{
+  NS_ASSERT_MSG (nRadios >= 1 && nRadios <= 16, "A sink has 1 to 16 radios");
+  NetDeviceContainer devices;
+  for (uint8_t radio = 0; radio < nRadios; radio++)
+    {
+      // deal the channels out over the radios: 11, 11 + nRadios, ... to the first one
+      uint32_t mask = 0;
+      for (uint8_t i = radio; i < 16; i += nRadios)
+        {
+          mask |= 1 << i;
+        }
+      Ptr<LrWpanFleeMac> fleemac = CreateObject<LrWpanFleeMac> ();
+      fleemac->SetAttribute ("Sink", BooleanValue (true));
+      fleemac->SetAttribute ("ChannelMask", UintegerValue (mask));
+      fleemac->SetAttribute ("SinkRadio", UintegerValue (radio));
+      fleemac->SetAttribute ("SinkRadios", UintegerValue (nRadios));
+      devices.Add (InstallFleeDevice (node, fleemac));
+    }
+  return devices;
+}
+
+Ptr<LrWpanCsmaNetDevice>
+LrWpanHelper::InstallFleeDevice (Ptr<Node> node, Ptr<LrWpanFleeMac> mac)
+{
+  Ptr<LrWpanCsmaNetDevice> netDevice = CreateObject<LrWpanCsmaNetDevice> ();
+  netDevice->SetMac (mac);
+  netDevice->SetChannel (m_channel);
+  node->AddDevice (netDevice);
+  netDevice->SetNode (node);
+  netDevice->GetPhy ()->SetPdDataStartNotionCallback (MakeCallback (&LrWpanFleeMac::PdDataStartNotion, mac));
+  netDevice->GetPhy ()->SetPdDataIndicationCallback (MakeCallback (&LrWpanFleeMac::PdDataIndication, mac));
+  return netDevice;
+}
+
 Ptr<SpectrumChannel>
 LrWpanHelper::GetChannel (void)
 {
@@ -235,6 +273,24 @@ LrWpanHelper::SetChannel (std::string channelName)
   m_channel = channel;
 }
 
+void
+LrWpanHelper::EnableSpatialGrid (double cutoffRadius)
+{
+  NS_LOG_FUNCTION (this << cutoffRadius);
+  Ptr<LrWpanGridSpectrumChannel> channel = CreateObject<LrWpanGridSpectrumChannel> ();
+  channel->SetCutoffRadius (cutoffRadius);
+  // both models below are deterministic, so the link budgets can be reused
+  channel->SetAttribute ("LinkBudgetCache", BooleanValue (true));
+
+  Ptr<LogDistancePropagationLossModel> lossModel = CreateObject<LogDistancePropagationLossModel> ();
+  channel->AddPropagationLossModel (lossModel);
+
+  Ptr<ConstantSpeedPropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  channel->SetPropagationDelayModel (delayModel);
+
+  m_channel = channel;
+}
+
 
 int64_t
 LrWpanHelper::AssignStreams (NetDeviceContainer c, int64_t stream)
@@ -248,6 +304,11 @@ LrWpanHelper::AssignStreams (NetDeviceContainer c, int64_t stream)
       if (lrwpan)
         {
           currentStream += lrwpan->AssignStreams (currentStream);
+          Ptr<LrWpanFleeMac> fleeMac = DynamicCast<LrWpanFleeMac> (lrwpan->GetMac ());
+          if (fleeMac)
+            {
+              currentStream += fleeMac->AssignStreams (currentStream);
+            }
         }
     }
   return (currentStream - stream);
@@ -286,6 +347,7 @@ LrWpanHelper::AssociateToPan (NetDeviceContainer c, uint16_t panId)
 static void
 PcapSniffLrWpan (Ptr<PcapFileWrapper> file, Ptr<const Packet> packet)
 {
+  FLEE_PROFILE_ZONE ("LrWpanHelper::PcapSniff");
   file->Write (Simulator::Now (), packet);
 }
 
@@ -437,26 +499,15 @@ LrWpanHelper::EnableAsciiInternal (
   device->GetMac ()->TraceConnect ("MacTxDrop", oss.str (), MakeBoundCallback (&AsciiTraceHelper::DefaultDropSinkWithContext, stream));
 }
 
-void
+Ptr<LrWpanTrafficSource>
 LrWpanHelper::GenerateTraffic(Ptr<NetDevice> dev, Address dst, int packet_size, double start, double duration, double interval)
 {
-  double end = start + duration;
-  Simulator::Schedule(Seconds(start),&LrWpanHelper::SendPacket,this,dev,dst,packet_size,interval,end);
-}
-
-void
-LrWpanHelper::SendPacket(Ptr<NetDevice> dev, Address dst, int packet_size, double interval,double end)
-{
-  if (Now().GetSeconds() <= end)
-    {
-      Ptr<Packet> pkt = Create<Packet> (packet_size);
-      dev->Send(pkt,dst,0x86DD);
-    }
-
-  if (Now().GetSeconds() <= end+interval && dev->GetObject<LrWpanNetDevice>()->GetPhy()->GetStatus()!=IEEE_802_15_4_PHY_FORCE_TRX_OFF)
-    {
-      Simulator::Schedule(Seconds(interval),&LrWpanHelper::SendPacket,this,dev,dst,packet_size,interval,end);
-    }
+  Ptr<LrWpanTrafficSource> source = CreateObject<LrWpanTrafficSource> ();
+  source->SetAttribute ("PacketSize", UintegerValue (packet_size));
+  source->SetAttribute ("Interval", TimeValue (Seconds (interval)));
+  source->SetDevice (dev, dst);
+  source->Start (Seconds (start), Seconds (duration));
+  return source;
 }
 
 } // namespace ns3
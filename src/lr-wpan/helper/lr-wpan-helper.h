@@ -26,11 +26,14 @@
 #include <ns3/lr-wpan-phy.h>
 #include <ns3/lr-wpan-mac.h>
 #include <ns3/trace-helper.h>
+#include <ns3/lr-wpan-traffic-source.h>
 
 namespace ns3 {
 
 class SpectrumChannel;
 class MobilityModel;
+class LrWpanFleeMac;
+class LrWpanCsmaNetDevice;
 
 /**
  * \ingroup lr-wpan
@@ -52,12 +55,20 @@ public AsciiTraceHelperForDevice
 public:
 
 	/**
-	 * \brief Generate constant traffice from dev
-	 * \internal
+	 * \brief Generate constant traffic from dev
 	 *
+	 * Creates a periodic LrWpanTrafficSource.  Configure one directly for
+	 * Poisson or on/off traffic.
 	 *
+	 * \param dev the device to send on
+	 * \param dst the destination of the packets
+	 * \param packet_size the size of the packets in bytes
+	 * \param start the delay until the first packet in s
+	 * \param duration the time after the start during which packets are sent in s
+	 * \param interval the time between two packets in s
+	 * \returns the traffic source, it can be stopped early
 	 */
-	void
+	Ptr<LrWpanTrafficSource>
 	GenerateTraffic(Ptr<NetDevice> dev, Address dst, int packet_size, double start, double duration, double interval);
 
 
@@ -101,6 +112,21 @@ public:
    */
   void SetChannel (std::string channelName);
 
+  /**
+   * \brief Replace the channel by a LrWpanGridSpectrumChannel
+   * \param cutoffRadius distance in meters beyond which no signal is delivered
+   *
+   * Signals are only evaluated for the PHYs in the grid cells around the
+   * transmitter, so the cost of a transmission depends on the node density
+   * instead of the number of nodes.  Pick the radius as the distance at which
+   * the received power drops below the receiver sensitivity, or 0 to only
+   * keep the per-channel receiver sets that LrWpanFleeMac maintains.  A
+   * LogDistancePropagationLossModel and a ConstantSpeedPropagationDelayModel
+   * are added to the new channel, and as both are deterministic, its
+   * LinkBudgetCache is enabled.  Call this before installing devices.
+   */
+  void EnableSpatialGrid (double cutoffRadius);
+
   /**
    * \brief Add mobility model to a physical device
    * \param phy the physical device
@@ -108,22 +134,29 @@ public:
    */
 	void AddMobility (Ptr<LrWpanPhy> phy, Ptr<MobilityModel> m);
 
-	/**
-	 * @brief SendPacket
-	 * @param dev
-	 * @param dst
-	 * @param packet_size
-	 * @param interval
-	 * @param end
-	 */
-	void SendPacket(Ptr<NetDevice> dev, Address dst, int packet_size, double interval,double end);
-
 	/**
 	 * \param c a set of nodes
    * \returns A container holding the added net devices.
 	 */
 	NetDeviceContainer Install (NodeContainer c);
 	NetDeviceContainer InstallFlee (NodeContainer c);
+	/**
+	 * \brief Install several FLEE radios on a sink.
+	 *
+	 * Every radio gets its own LrWpanCsmaNetDevice and LrWpanFleeMac, and
+	 * its own share of the channels 11 to 26, so the radios receive on
+	 * different channels at the same time.  The children are dealt out over
+	 * the radios by short address, and a radio does not set up a link to a
+	 * child that another radio serves.  The FleeRouting instance of the node
+	 * treats every radio as an interface, and its hellos tell the children
+	 * which radio serves them.  Set a mobility model on the PHY of every
+	 * radio, like for the other devices.
+	 *
+	 * \param node the sink
+	 * \param nRadios the number of radios, 1 to 16
+	 * \returns A container holding the added net devices.
+	 */
+	NetDeviceContainer InstallFleeSink (Ptr<Node> node, uint8_t nRadios);
 
 	/**
 	 * \brief Associate the nodes to the same PAN
@@ -176,6 +209,13 @@ private:
    * \returns
    */
 	LrWpanHelper& operator= (LrWpanHelper const &);
+	/**
+	 * \brief Add a FLEE net device with the given MAC to a node.
+	 * \param node the node
+	 * \param mac the FLEE MAC of the device
+	 * \returns the new net device
+	 */
+	Ptr<LrWpanCsmaNetDevice> InstallFleeDevice (Ptr<Node> node, Ptr<LrWpanFleeMac> mac);
 	/**
 	 * \brief Enable pcap output on the indicated net device.
 	 *
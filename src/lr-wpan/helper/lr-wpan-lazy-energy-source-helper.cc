@@ -0,0 +1,51 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-lazy-energy-source-helper.h"
+#include <ns3/lr-wpan-lazy-energy-source.h>
+
+namespace ns3 {
+
+LrWpanLazyEnergySourceHelper::LrWpanLazyEnergySourceHelper ()
+{
+  m_lazyEnergySource.SetTypeId ("ns3::LrWpanLazyEnergySource");
+}
+
+LrWpanLazyEnergySourceHelper::~LrWpanLazyEnergySourceHelper ()
+{
+}
+
+void
+LrWpanLazyEnergySourceHelper::Set (std::string name, const AttributeValue &v)
+{
+  m_lazyEnergySource.Set (name, v);
+}
+
+Ptr<EnergySource>
+LrWpanLazyEnergySourceHelper::DoInstall (Ptr<Node> node) const
+{
+  NS_ASSERT (node != 0);
+  Ptr<EnergySource> energySource = m_lazyEnergySource.Create<EnergySource> ();
+  NS_ASSERT (energySource != 0);
+  energySource->SetNode (node);
+  return energySource;
+}
+
+} // namespace ns3
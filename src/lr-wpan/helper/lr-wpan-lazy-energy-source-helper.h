@@ -0,0 +1,64 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_LAZY_ENERGY_SOURCE_HELPER_H
+#define LR_WPAN_LAZY_ENERGY_SOURCE_HELPER_H
+
+#include <ns3/energy-model-helper.h>
+#include <ns3/node.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Creates a LrWpanLazyEnergySource object.
+ *
+ * Takes the same attributes as the LrWpanEnergySourceHelper, except for
+ * PeriodicEnergyUpdateInterval: the source only updates at the state
+ * changes of the radio and when its remaining energy is read.
+ */
+class LrWpanLazyEnergySourceHelper : public EnergySourceHelper
+{
+public:
+  LrWpanLazyEnergySourceHelper ();
+  ~LrWpanLazyEnergySourceHelper ();
+
+  /**
+   * \param name the name of the attribute to set
+   * \param v the value of the attribute
+   *
+   * Sets an attribute of the LrWpanLazyEnergySource.
+   */
+  void Set (std::string name, const AttributeValue &v);
+
+private:
+  /**
+   * \param node Pointer to node where the energy source is to be installed.
+   * \returns Pointer to the created LrWpanLazyEnergySource.
+   */
+  virtual Ptr<EnergySource> DoInstall (Ptr<Node> node) const;
+
+  ObjectFactory m_lazyEnergySource; //!< factory of the energy sources
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_LAZY_ENERGY_SOURCE_HELPER_H */
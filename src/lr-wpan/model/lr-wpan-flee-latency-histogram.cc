@@ -0,0 +1,135 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-flee-latency-histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ns3 {
+
+LrWpanFleeLatencyHistogram::LrWpanFleeLatencyHistogram ()
+{
+  Reset ();
+}
+
+void
+LrWpanFleeLatencyHistogram::Reset (void)
+{
+  std::fill (m_buckets, m_buckets + N_BUCKETS, 0);
+  m_count = 0;
+  m_sum = 0;
+  m_max = 0;
+}
+
+uint32_t
+LrWpanFleeLatencyHistogram::GetBucket (uint64_t ns)
+{
+  if (ns < (1ULL << MIN_SHIFT))
+    {
+      return 0;
+    }
+  uint32_t msb = 63 - __builtin_clzll (ns);
+  uint32_t octave = msb - MIN_SHIFT;
+  if (octave >= OCTAVES)
+    {
+      return N_BUCKETS - 1;
+    }
+  // the two bits below the most significant one pick the bucket in the octave
+  uint32_t sub = (ns >> (msb - 2)) & (SUB_BUCKETS - 1);
+  return 1 + octave * SUB_BUCKETS + sub;
+}
+
+uint64_t
+LrWpanFleeLatencyHistogram::GetUpperBound (uint32_t bucket)
+{
+  if (bucket == 0)
+    {
+      return (1ULL << MIN_SHIFT) - 1;
+    }
+  uint32_t octave = (bucket - 1) / SUB_BUCKETS;
+  uint32_t sub = (bucket - 1) % SUB_BUCKETS;
+  uint32_t msb = octave + MIN_SHIFT;
+  return ((SUB_BUCKETS + sub + 1ULL) << (msb - 2)) - 1;
+}
+
+void
+LrWpanFleeLatencyHistogram::Add (Time delay)
+{
+  int64_t ns = delay.GetNanoSeconds ();
+  uint64_t sample = ns > 0 ? ns : 0;
+  m_buckets[GetBucket (sample)]++;
+  m_count++;
+  m_sum += sample;
+  m_max = std::max (m_max, sample);
+}
+
+void
+LrWpanFleeLatencyHistogram::Merge (const LrWpanFleeLatencyHistogram &other)
+{
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      m_buckets[i] += other.m_buckets[i];
+    }
+  m_count += other.m_count;
+  m_sum += other.m_sum;
+  m_max = std::max (m_max, other.m_max);
+}
+
+uint64_t
+LrWpanFleeLatencyHistogram::GetCount (void) const
+{
+  return m_count;
+}
+
+Time
+LrWpanFleeLatencyHistogram::GetMean (void) const
+{
+  return NanoSeconds (m_count > 0 ? m_sum / m_count : 0);
+}
+
+Time
+LrWpanFleeLatencyHistogram::GetMax (void) const
+{
+  return NanoSeconds (m_max);
+}
+
+Time
+LrWpanFleeLatencyHistogram::GetPercentile (double q) const
+{
+  if (m_count == 0)
+    {
+      return Seconds (0);
+    }
+  // the rank of the sample, 1 for the smallest one
+  uint64_t rank = std::max<uint64_t> (1, (uint64_t) std::ceil (q * m_count));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      seen += m_buckets[i];
+      if (seen >= rank)
+        {
+          // the last bucket has no upper bound, and no bucket goes beyond the largest sample
+          return NanoSeconds (i == N_BUCKETS - 1 ? m_max : std::min (GetUpperBound (i), m_max));
+        }
+    }
+  return NanoSeconds (m_max);
+}
+
+} // namespace ns3
@@ -0,0 +1,110 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_FLEE_LATENCY_HISTOGRAM_H
+#define LR_WPAN_FLEE_LATENCY_HISTOGRAM_H
+
+#include <ns3/nstime.h>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Histogram of delays with logarithmic buckets
+ *
+ * Every power of two from 1024 ns up to 2^38 ns (about 4.5 minutes) is split
+ * in 4 buckets, so a percentile is off by at most 25%.  Shorter delays share
+ * the first bucket and longer ones the last.  The buckets are a fixed array,
+ * adding a sample never allocates.
+ */
+class LrWpanFleeLatencyHistogram
+{
+public:
+  LrWpanFleeLatencyHistogram ();
+
+  /**
+   * \param delay the delay to add
+   */
+  void Add (Time delay);
+
+  /**
+   * \param other the histogram to add to this one
+   */
+  void Merge (const LrWpanFleeLatencyHistogram &other);
+
+  /**
+   * Remove all samples.
+   */
+  void Reset (void);
+
+  /**
+   * \return the number of samples
+   */
+  uint64_t GetCount (void) const;
+
+  /**
+   * \return the mean of the samples, 0 without samples
+   */
+  Time GetMean (void) const;
+
+  /**
+   * \return the largest sample, 0 without samples
+   */
+  Time GetMax (void) const;
+
+  /**
+   * \param q the quantile, between 0 and 1, e.g. 0.99 for p99
+   * \return the upper bound of the bucket that holds the quantile, 0 without samples
+   */
+  Time GetPercentile (double q) const;
+
+private:
+  /// the shortest delay in ns that gets a bucket of its own is 2^MIN_SHIFT
+  static const uint32_t MIN_SHIFT = 10;
+  /// the number of powers of two with buckets
+  static const uint32_t OCTAVES = 28;
+  /// buckets per power of two
+  static const uint32_t SUB_BUCKETS = 4;
+  /// the first bucket for short delays, the buckets per octave and the last one for long delays
+  static const uint32_t N_BUCKETS = 1 + OCTAVES * SUB_BUCKETS + 1;
+
+  /**
+   * \param ns a delay in ns
+   * \return the bucket of the delay
+   */
+  static uint32_t GetBucket (uint64_t ns);
+
+  /**
+   * \param bucket a bucket
+   * \return the largest delay in ns of the bucket
+   */
+  static uint64_t GetUpperBound (uint32_t bucket);
+
+  uint64_t m_buckets[N_BUCKETS];  //!< samples per bucket
+  uint64_t m_count;               //!< number of samples
+  uint64_t m_sum;                 //!< sum of the samples in ns
+  uint64_t m_max;                 //!< largest sample in ns
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_FLEE_LATENCY_HISTOGRAM_H */
@@ -0,0 +1,96 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_FLEE_MAC_TEST_ACCESS_H
+#define LR_WPAN_FLEE_MAC_TEST_ACCESS_H
+
+#include <ns3/lr-wpan-flee-mac.h>
+#include <ns3/simulator.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Access to the slot scheduler of an LrWpanFleeMac for tests and
+ * benchmarks
+ *
+ * The slot scheduler normally only runs from the cycle timer.  This class
+ * lets a test stop that timer and call the scheduler directly.  It is not
+ * meant for simulation scenarios.
+ */
+class LrWpanFleeMacTestAccess
+{
+public:
+  /**
+   * \brief Stop the slot cycle, so the MAC schedules no slots on its own.
+   * \param mac the MAC
+   */
+  static void StopCycle (Ptr<LrWpanFleeMac> mac)
+  {
+    Simulator::Cancel (mac->m_startEvent);
+    mac->m_timer.Cancel ();
+  }
+
+  /**
+   * \brief Schedule the slots of one cycle, as at the start of a cycle.
+   * \param mac the MAC
+   */
+  static void ScheduleSlots (Ptr<LrWpanFleeMac> mac)
+  {
+    mac->ScheduleSlots ();
+  }
+
+  /**
+   * \brief Run the slot of a neighbour, as scheduled for the current setup of its link.
+   * \param mac the MAC
+   * \param addr the neighbour
+   */
+  static void ScheduleSlot (Ptr<LrWpanFleeMac> mac, const Address &addr)
+  {
+    std::map<Address, LrWpanFleeMac::LinkSpecs>::const_iterator link = mac->m_connectable.find (addr);
+    mac->ScheduleSlot (addr, link == mac->m_connectable.end () ? 0 : std::get<6> (link->second));
+  }
+
+  /**
+   * \brief Hand a received frame to the MAC, as the base MAC does.
+   * \param mac the MAC
+   * \param params the indication parameters
+   * \param pkt the frame
+   */
+  static void McpsDataIndication (Ptr<LrWpanFleeMac> mac, McpsDataIndicationParams params, Ptr<Packet> pkt)
+  {
+    mac->McpsDataIndication (params, pkt);
+  }
+
+  /**
+   * \brief Set the offset in the cycle at which the next received frame started.
+   * \param mac the MAC
+   * \param start the offset
+   */
+  static void SetLatestStart (Ptr<LrWpanFleeMac> mac, Time start)
+  {
+    mac->m_latestStart = start;
+  }
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_FLEE_MAC_TEST_ACCESS_H */
@@ -22,7 +22,12 @@
 #include "lr-wpan-mac.h"
 #include "lr-wpan-csmaca.h"
 #include "lr-wpan-mac-header.h"
+#include "lr-wpan-mac-trailer.h"
 #include "lr-wpan-phy.h"
+#include "lr-wpan-grid-spectrum-channel.h"
+#include "lr-wpan-flee-profiler.h"
+#include "lr-wpan-flee-timestamp-tag.h"
+#include "lr-wpan-flee-state.h"
 #include <ns3/simulator.h>
 #include <ns3/log.h>
 #include <ns3/uinteger.h>
@@ -30,10 +35,16 @@
 #include <ns3/packet.h>
 #include <ns3/random-variable-stream.h>
 #include <ns3/double.h>
+#include <ns3/boolean.h>
+#include <ns3/nstime.h>
 #include <ns3/timer.h>
-#include <ns3/watchdog.h>
 #include <ns3/llc-snap-header.h>
 #include <tuple>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <math.h>
 
 namespace ns3 {
 
@@ -48,6 +59,82 @@ namespace ns3 {
 				.SetParent<LrWpanMac> ()
 				.SetGroupName ("LrWpan")
 				.AddConstructor<LrWpanFleeMac> ()
+				.AddAttribute ("EtxWeight",
+						"Weight of the newest unicast outcome in the link quality average",
+						DoubleValue (0.1),
+						MakeDoubleAccessor (&LrWpanFleeMac::m_etxWeight),
+						MakeDoubleChecker<double> (0.0, 1.0))
+				.AddAttribute ("MaxExtraSlots",
+						"Maximum number of extra slots that follow the slot of a backlogged link in one cycle",
+						UintegerValue (4),
+						MakeUintegerAccessor (&LrWpanFleeMac::m_maxExtraSlots),
+						MakeUintegerChecker<uint8_t> ())
+				.AddAttribute ("Burst",
+						"Keep sending queued frames to a neighbour after an acknowledgement while its slot lasts",
+						BooleanValue (true),
+						MakeBooleanAccessor (&LrWpanFleeMac::m_burst),
+						MakeBooleanChecker ())
+				.AddAttribute ("LatencyStats",
+						"Tag the frames with their enqueue and slot times and keep histograms of the delays",
+						BooleanValue (false),
+						MakeBooleanAccessor (&LrWpanFleeMac::m_latencyStats),
+						MakeBooleanChecker ())
+				.AddAttribute ("ChannelQualityWeight",
+						"Weight of the newest outcome in the success rate average of a channel",
+						DoubleValue (0.1),
+						MakeDoubleAccessor (&LrWpanFleeMac::m_channelQualityWeight),
+						MakeDoubleChecker<double> (0.0, 1.0))
+				.AddAttribute ("ChannelBlacklistThreshold",
+						"Channels whose success rate drops below this value are no longer used",
+						DoubleValue (0.5),
+						MakeDoubleAccessor (&LrWpanFleeMac::m_blacklistThreshold),
+						MakeDoubleChecker<double> (0.0, 1.0))
+				.AddAttribute ("ChannelBlacklistTimeout",
+						"Time after which a blacklisted channel is tried again",
+						TimeValue (Seconds (10)),
+						MakeTimeAccessor (&LrWpanFleeMac::m_blacklistTimeout),
+						MakeTimeChecker ())
+				.AddAttribute ("MinChannels",
+						"Number of channels that are never blacklisted",
+						UintegerValue (4),
+						MakeUintegerAccessor (&LrWpanFleeMac::m_minChannels),
+						MakeUintegerChecker<uint8_t> (1, 16))
+				.AddAttribute ("Sink",
+						"This radio belongs to a sink, it does not set up links to neighbours that another radio of the sink serves",
+						BooleanValue (false),
+						MakeBooleanAccessor (&LrWpanFleeMac::m_sink),
+						MakeBooleanChecker ())
+				.AddAttribute ("SinkRadio",
+						"Index of this radio among the radios of its sink, it serves the neighbours whose short address modulo SinkRadios equals it",
+						UintegerValue (0),
+						MakeUintegerAccessor (&LrWpanFleeMac::m_sinkRadio),
+						MakeUintegerChecker<uint8_t> (0, 15))
+				.AddAttribute ("SinkRadios",
+						"Number of radios of the sink this radio belongs to",
+						UintegerValue (1),
+						MakeUintegerAccessor (&LrWpanFleeMac::m_nSinkRadios),
+						MakeUintegerChecker<uint8_t> (1, 16))
+				.AddAttribute ("ChannelMask",
+						"Channels this radio may use, bit i stands for channel 11 + i",
+						UintegerValue (0xffff),
+						MakeUintegerAccessor (&LrWpanFleeMac::m_channelMask),
+						MakeUintegerChecker<uint32_t> (1, 0xffff))
+				.AddTraceSource ("CanTx",
+						"Whether the broadcast slots of this cycle may be used to transmit",
+						MakeTraceSourceAccessor (&LrWpanFleeMac::m_canTx),
+						"ns3::TracedValueCallback::Bool")
+				.AddTraceSource ("Slot",
+						"A slot is used to transmit, to receive or left idle",
+						MakeTraceSourceAccessor (&LrWpanFleeMac::m_slotTrace),
+						"ns3::LrWpanFleeMac::SlotTracedCallback")
+				.AddTraceSource ("Prune",
+						"A neighbour is dropped from the table",
+						MakeTraceSourceAccessor (&LrWpanFleeMac::m_pruneTrace),
+						"ns3::LrWpanFleeMac::PruneTracedCallback")
+				.AddTraceSource ("BroadcastCopy",
+						"A copy of a broadcast frame is sent",
+						MakeTraceSourceAccessor (&LrWpanFleeMac::m_broadcastCopyTrace),
+						"ns3::LrWpanFleeMac::BroadcastCopyTracedCallback")
 				;
 			return tid;
 		}
@@ -59,12 +146,32 @@ namespace ns3 {
 		m_broadcastChannel = 11;
 		m_canTx = true;
 		m_var = CreateObject<UniformRandomVariable>();
+		m_txSlotIndex = 0;
+		m_linkChanges = 0;
+		m_linkGeneration = 0;
+		m_sink = false;
+		m_sinkRadio = 0;
+		m_nSinkRadios = 1;
+		m_latencyStats = false;
+		for (uint8_t i = 0; i < 16; i++)
+		{
+			m_channelQuality[i] = 1.0;
+			m_blacklistedUntil[i] = Seconds (0);
+		}
+		ResetStats ();
 	}
 
 	LrWpanFleeMac::~LrWpanFleeMac ()
 	{
 	}
 
+	void
+		LrWpanFleeMac::DoDispose ()
+		{
+			m_expectedFrom.clear ();
+			LrWpanMac::DoDispose ();
+		}
+
 	void
 		LrWpanFleeMac::DoInitialize ()
 		{
@@ -78,7 +185,7 @@ namespace ns3 {
 			m_timer.SetDelay(MilliSeconds(m_timerLength));
 			m_timer.SetFunction(&LrWpanFleeMac::EndTimer,this);
 			// randomize timers
-			Simulator::Schedule (MilliSeconds(m_var->GetInteger(0,m_timerLength*2)),&LrWpanFleeMac::EndTimer, this);
+			m_startEvent = Simulator::Schedule (MilliSeconds(m_var->GetInteger(0,m_timerLength*2)),&LrWpanFleeMac::EndTimer, this);
 			// intercept callbacks
 			LrWpanMac::SetMcpsDataIndicationCallback (MakeCallback(&LrWpanFleeMac::McpsDataIndication, this));
 			LrWpanMac::SetMcpsDataConfirmCallback (MakeCallback(&LrWpanFleeMac::McpsDataConfirm, this));
@@ -89,6 +196,13 @@ namespace ns3 {
 			attributes->phyCCAMode = 4; // turn off CCA!
 			m_phy->PlmeSetAttributeRequest (LrWpanPibAttributeIdentifier::phyCCAMode,attributes);
 			m_phy->SetPlmeGetAttributeConfirmCallback (MakeCallback(&LrWpanFleeMac::PlmeGetAttributeConfirm,this));
+			// only receive signals on our own channel if the spectrum channel supports it
+			m_gridChannel = DynamicCast<LrWpanGridSpectrumChannel> (m_phy->GetChannel ());
+			// start on the first channel we may use
+			if (!IsChannelUsable (m_broadcastChannel))
+				IncrementBroadcastChannel ();
+			m_channelNumber = m_broadcastChannel;
+			SwitchChannel (m_channelNumber);
 
 			// configure default CSMA MAC layer
 			LrWpanMac::DoInitialize ();
@@ -113,6 +227,15 @@ namespace ns3 {
 		NS_LOG_FUNCTION (this);
 		// csma always deletes first packet
 		// here we pick packet to transmit
+		LrWpanMacHeader mh;
+		m_currentTxPkt->PeekHeader(mh);
+		std::map<Address, std::deque<uint32_t> >::iterator queued = m_queuedFor.find (mh.GetShortDstAddr ());
+		if (queued != m_queuedFor.end ())
+		{
+			queued->second.pop_front ();
+			if (queued->second.empty ())
+				m_queuedFor.erase (queued);
+		}
 		DeleteFromQueue(m_currentTxPkt);
 	}
 
@@ -150,15 +273,28 @@ namespace ns3 {
 		LrWpanFleeMac::McpsDataRequest (McpsDataRequestParams params, Ptr<Packet> p)
 		{
 			NS_LOG_FUNCTION(this);
+			if (m_latencyStats)
+			{
+				// a forwarded frame keeps its origin and hop count
+				LrWpanFleeTimestampTag tag;
+				if (!p->RemovePacketTag (tag))
+					tag.SetOrigin (Simulator::Now ());
+				tag.SetEnqueue (Simulator::Now ());
+				tag.SetSlotStart (Simulator::Now ());
+				p->AddPacketTag (tag);
+			}
 			if (params.m_dstAddr == Mac16Address ("ff:ff"))
 			{
-				// send it on all frequencies (so copy packet 16 times)
-				for (uint8_t i = 0; i< 16; i++)
+				// send it on all usable frequencies (so copy packet up to 16 times)
+				for (uint8_t i = 0; i< GetNUsableChannels (); i++)
 					LrWpanMac::McpsDataRequest (params,p->Copy());
 			}
 			else
+			{
 				//if not broadcast just pass this request
-					LrWpanMac::McpsDataRequest (params,p);
+				m_queuedFor[params.m_dstAddr].push_back (p->GetSize ());
+				LrWpanMac::McpsDataRequest (params,p);
+			}
 		}
  
 	//Passing ACK from MAC to netdevice
@@ -168,9 +304,35 @@ namespace ns3 {
 		LrWpanMacHeader mh;
 		m_currentTxPkt->PeekHeader(mh);
 		Address addr = mh.GetShortDstAddr();
-		//and increment the timeout event
+		//and push back the timeout
 		if (addr != Mac16Address ("ff:ff"))
-			std::get<5>(m_connectable[addr])->Ping(MilliSeconds(10*m_timerLength));
+		{
+			std::map<Address, LinkSpecs >::iterator it = m_connectable.find (addr);
+			if (it != m_connectable.end ())
+				std::get<5>(it->second) = Simulator::Now ();
+			if (m_latencyStats && params.m_status == IEEE_802_15_4_SUCCESS)
+			{
+				LrWpanFleeTimestampTag tag;
+				if (m_currentTxPkt->PeekPacketTag (tag))
+				{
+					m_queueLatency.Add (tag.GetSlotStart () - tag.GetEnqueue ());
+					m_txLatency.Add (Simulator::Now () - tag.GetSlotStart ());
+				}
+			}
+			// keep track of the quality of this link, new links start out perfect
+			double success = (params.m_status == IEEE_802_15_4_SUCCESS) ? 1.0 : 0.0;
+			std::map<Address, double>::iterator link = m_linkDelivery.find (addr);
+			if (link == m_linkDelivery.end ())
+				m_linkDelivery[addr] = 1.0 - m_etxWeight + m_etxWeight*success;
+			else
+				link->second += m_etxWeight*(success - link->second);
+			// and of the channel it is on
+			if (it != m_connectable.end ())
+				UpdateChannelQuality (std::get<0>(it->second), success > 0);
+			// we told the receiver more frames follow, once this one left the queue send the next
+			if (params.m_status == IEEE_802_15_4_SUCCESS && mh.IsFrmPend ())
+				Simulator::ScheduleNow (&LrWpanFleeMac::ContinueBurst, this, addr);
+		}
 		// and pass it on to wherever
 		if (!m_mcpsDataConfirmCallback.IsNull ())
 			m_mcpsDataConfirmCallback(params);
@@ -180,6 +342,22 @@ namespace ns3 {
 		LrWpanFleeMac::McpsDataIndication (McpsDataIndicationParams params, Ptr<Packet> pkt)
 		{
 			NS_LOG_FUNCTION (this);
+			if (m_latencyStats)
+			{
+				LrWpanFleeTimestampTag tag;
+				if (pkt->RemovePacketTag (tag))
+				{
+					tag.SetHops (tag.GetHops () + 1);
+					// only data sent to us, not the broadcasts or the routing control messages
+					if (params.m_dstAddr == m_shortAddress && !tag.IsControl ())
+					{
+						if (m_deliveryLatency.size () <= tag.GetHops ())
+							m_deliveryLatency.resize (tag.GetHops () + 1);
+						m_deliveryLatency[tag.GetHops ()].Add (Simulator::Now () - tag.GetOrigin ());
+					}
+					pkt->AddPacketTag (tag);
+				}
+			}
 			// check current channel
 			m_phy->PlmeGetAttributeRequest(LrWpanPibAttributeIdentifier::phyCurrentChannel);
 			std::map<Address, LinkSpecs >::iterator it;
@@ -192,42 +370,56 @@ namespace ns3 {
 				LlcSnapHeader llc;
 				pkt->PeekHeader (llc);
 
+				// another radio of this sink serves the neighbour, its hellos told it so
+				if (IsServedBySibling (params.m_srcAddr))
+				{
+					m_mcpsDataIndicationCallback (params, pkt);
+					return;
+				}
 				if (params.m_dstAddr != m_shortAddress)
 				{
 					// it is a broadcast message!
 					NS_LOG_LOGIC("Not dedicated to us");
-					// create watchdog timer for timeout or desynchronization
-					Watchdog* wd = new Watchdog ();
-					wd->SetFunction (&LrWpanFleeMac::PruneConnection,this);
-					wd->SetArguments ( (Address)params.m_srcAddr);
-					// initialize only 2 cycles, maybe we or they don't want to connect
-					wd->Ping (MilliSeconds (2*m_timerLength));
-					// add it to database
-					m_connectable[params.m_srcAddr]=std::make_tuple(m_channelNumber,m_latestStart.GetMilliSeconds(),0,false,true, wd);
+					// add it to database, it times out after only 2 cycles as long as it
+					// is not confirmed, maybe we or they don't want to connect
+					m_connectable[params.m_srcAddr]=std::make_tuple(m_channelNumber,m_latestStart.GetMilliSeconds(),0,false,true, Simulator::Now (),++m_linkGeneration);
+					m_linkChanges++;
 				}
 				else
 				{
 					NS_LOG_LOGIC ("this case");
-					// create watchdog timer for timeout or desynchronization
-					Watchdog* wd = new Watchdog ();
-					wd->SetFunction (&LrWpanFleeMac::PruneConnection,this);
-					wd->SetArguments ((Address)params.m_srcAddr);
-					wd->Ping (MilliSeconds (10*m_timerLength)); 
 					// add it to database, it is official
-					m_connectable[params.m_srcAddr]=std::make_tuple(m_channelNumber,m_latestStart.GetMilliSeconds (),0,true,true,wd);
+					m_connectable[params.m_srcAddr]=std::make_tuple(m_channelNumber,m_latestStart.GetMilliSeconds (),0,true,true,Simulator::Now (),++m_linkGeneration);
+					m_linkChanges++;
 				}
 			}
 			else
 			{
 				// we do know it
-				// increment timeout
-				std::get<5> (it->second)->Ping(MilliSeconds(10*m_timerLength));
+				// push back the timeout
+				std::get<5> (it->second) = Simulator::Now ();
 				// set that connection is confirmed
+				if (!std::get<3> (it->second))
+					m_linkChanges++;
 				std::get<3> (it->second) = true;
+				// the neighbour dropped our link from a blacklisted channel and set it up again
+				// on another one, answering one of our broadcasts, so follow it
+				if (params.m_dstAddr == m_shortAddress && std::get<0> (it->second) != m_channelNumber)
+				{
+					NS_LOG_DEBUG ("Link to " << params.m_srcAddr << " moved to channel " << (uint32_t)m_channelNumber);
+					std::get<0> (it->second) = m_channelNumber;
+					std::get<1> (it->second) = m_latestStart.GetMilliSeconds ();
+					std::get<4> (it->second) = true;
+					std::get<6> (it->second) = ++m_linkGeneration;
+					m_linkChanges++;
+				}
 				// save
 				m_connectable[params.m_srcAddr]=it->second;
 			}
 
+			// receptions do not count for the channel quality, as a lost frame is never noticed
+			// here, only acknowledgments and announced frames that did not come do
+
 			// pass it for default beheaviour to higher layers
 			m_mcpsDataIndicationCallback (params, pkt);
 		}
@@ -236,6 +428,8 @@ namespace ns3 {
 		LrWpanFleeMac::EndTimer (void)
 		{
 			NS_LOG_FUNCTION(this);
+			// drop the links that timed out before they get slots
+			SweepLinks ();
 			// reschedule timer
 			Simulator::ScheduleNow (&LrWpanFleeMac::ScheduleSlots,this);
 			m_timer.Schedule();
@@ -248,12 +442,14 @@ namespace ns3 {
 	void 
 		LrWpanFleeMac::ScheduleSlots (void)
 		{
+			FLEE_PROFILE_ZONE ("LrWpanFleeMac::ScheduleSlots");
 			//NS_LOG_FUNCTION(this);
 			if (m_connectable.size() > 0)
 				// schedule all connections in DB
 				for (std::map<Address,LinkSpecs >::iterator it = m_connectable.begin(); it != m_connectable.end(); ++it)
 				{
-					Simulator::Schedule (MilliSeconds(std::get<1>(it->second)),&LrWpanFleeMac::ScheduleSlot, this, it->first);
+					Simulator::Schedule (MilliSeconds(std::get<1>(it->second)),&LrWpanFleeMac::ScheduleSlot, this, it->first, std::get<6>(it->second));
+					FLEE_MAC_STATS (m_stats.slotsScheduled++);
 					double mindiff = m_timerLength;
 					for (std::map<Address,LinkSpecs >::iterator it2 = m_connectable.begin(); it2 != m_connectable.end(); ++it2)
 					{
@@ -270,7 +466,8 @@ namespace ns3 {
 							if (m_canTx)
 							{
 								NS_LOG_DEBUG("scheduling new transmission 1 at " << (uint8_t)i%(uint8_t)m_timerLength << " ms");
-								Simulator::Schedule (MilliSeconds((uint8_t)i%(uint8_t)m_timerLength),&LrWpanFleeMac::ScheduleSlot, this, Mac16Address ("ff:ff"));
+								Simulator::Schedule (MilliSeconds((uint8_t)i%(uint8_t)m_timerLength),&LrWpanFleeMac::ScheduleSlot, this, Mac16Address ("ff:ff"), 0);
+								FLEE_MAC_STATS (m_stats.slotsScheduled++);
 							}
 					}
 				}
@@ -280,7 +477,8 @@ namespace ns3 {
 					if (m_canTx)
 					{
 						NS_LOG_DEBUG("scheduling new transmission at " << i << " ms");
-						Simulator::Schedule (MilliSeconds(i),&LrWpanFleeMac::ScheduleSlot, this, Mac16Address ("ff:ff"));
+						Simulator::Schedule (MilliSeconds(i),&LrWpanFleeMac::ScheduleSlot, this, Mac16Address ("ff:ff"), 0);
+						FLEE_MAC_STATS (m_stats.slotsScheduled++);
 					}
 			if (CheckQueueFor(Mac16Address ("ff:ff")))
 				m_canTx = !m_canTx;
@@ -293,30 +491,44 @@ namespace ns3 {
 
 
 	void 
-		LrWpanFleeMac::ScheduleSlot (const Address& addr)
+		LrWpanFleeMac::ScheduleSlot (const Address& addr, uint32_t generation)
 		{
 			LinkSpecs settings; 
 			if (addr != Mac16Address ("ff:ff"))
-				settings = m_connectable[addr];
+			{
+				std::map<Address, LinkSpecs >::iterator link = m_connectable.find (addr);
+				// the link was dropped or set up again since this cycle was scheduled
+				if (link == m_connectable.end () || std::get<6>(link->second) != generation)
+				{
+					FLEE_MAC_STATS (m_stats.slotsIdle++);
+					FLEE_MAC_STATS (m_slotTrace (addr, 0, SLOT_IDLE));
+					return;
+				}
+				settings = link->second;
+			}
 			else
 			{
+				// give way to the extra slot of a backlogged link
+				m_extraSlots.erase (m_extraSlots.begin (), m_extraSlots.lower_bound (Simulator::Now () - MilliSeconds (m_broadcastInterval)));
+				std::set<Time>::const_iterator extra = m_extraSlots.lower_bound (Simulator::Now () - MilliSeconds (m_broadcastInterval));
+				if (extra != m_extraSlots.end () && *extra < Simulator::Now () + MilliSeconds (m_broadcastInterval))
+				{
+					FLEE_MAC_STATS (m_stats.slotsIdle++);
+					FLEE_MAC_STATS (m_slotTrace (addr, m_broadcastChannel, SLOT_IDLE));
+					return;
+				}
 				if (CheckQueueFor(Mac16Address ("ff:ff")))
 				{
 					NS_LOG_LOGIC ("there is something in the queue" << !m_canTx );
 					if (!m_canTx)
 						IncrementBroadcastChannel ();
-					settings = std::make_tuple (m_broadcastChannel,0,0,true,!m_canTx, new Watchdog());
+					settings = std::make_tuple (m_broadcastChannel,0,0,true,!m_canTx, Simulator::Now (), 0);
 				}
 				else
-					settings = std::make_tuple (m_broadcastChannel,0,0,true,false, new Watchdog ());
-			}
-			// check if this connection has been pruned
-			if (std::get<0> (settings) == 0)
-			{
-				// prune it again to create more slots
-				std::get<5>(settings)->Ping (Seconds(0));
-				return;
+					settings = std::make_tuple (m_broadcastChannel,0,0,true,false, Simulator::Now (), 0);
 			}
+			// a pruned link already left the slot idle above, both branches set a real channel
+			NS_ASSERT (std::get<0> (settings) >= 11 && std::get<0> (settings) <= 26);
 
 			if (std::get<4> (settings))
 			{
@@ -325,18 +537,28 @@ namespace ns3 {
 				{
 					NS_LOG_FUNCTION(this << addr << std::get<4>(settings) << (uint32_t)std::get<0>(settings));
 					// prepare receiving slot frequency
-					LrWpanPhyPibAttributes *attributes = new LrWpanPhyPibAttributes ();
-					attributes->phyCurrentChannel = std::get<0>(settings); 
-					// turn RX on when IDLE
-					m_phy->PlmeSetAttributeRequest (LrWpanPibAttributeIdentifier::phyCurrentChannel,attributes);
+					SwitchChannel (std::get<0>(settings));
 					m_currentTxPkt = m_txPkt;
+					StampSlotStart (m_currentTxPkt);
+					if (addr != Mac16Address ("ff:ff"))
+					{
+						// ask for an extra slot if more frames are waiting for this neighbour
+						m_txSlotStart = Simulator::Now ();
+						m_txSlotIndex = 0;
+						SetFramePending (m_currentTxPkt, HasMoreFrames (addr, 0));
+					}
 					Simulator::ScheduleNow(&LrWpanFleeMac::ChangeMacState,this,MAC_SENDING);
 					m_setMacState = Simulator::ScheduleNow (&LrWpanPhy::PlmeSetTRXStateRequest, m_phy, IEEE_802_15_4_PHY_TX_ON);
+					FLEE_MAC_STATS (m_stats.slotsTx++);
+					FLEE_MAC_STATS (m_slotTrace (addr, std::get<0>(settings), SLOT_TX));
 					if (addr == Mac16Address ("ff:ff"))
 					{
+						FLEE_MAC_STATS (m_stats.broadcastCopies[std::get<0>(settings) - 11]++);
+						FLEE_MAC_STATS (m_broadcastCopyTrace (std::get<0>(settings)));
 						// Schedule a receive slot on this channel for devices to connect to
 						Simulator::Schedule(MilliSeconds(m_timerLength),&LrWpanFleeMac::SetBroadcastChannel, this, m_broadcastChannel);
-						Simulator::Schedule(MilliSeconds(m_timerLength),&LrWpanFleeMac::ScheduleSlot, this, addr);
+						Simulator::Schedule(MilliSeconds(m_timerLength),&LrWpanFleeMac::ScheduleSlot, this, addr, 0);
+						FLEE_MAC_STATS (m_stats.slotsScheduled++);
 					}
 				}
 				else
@@ -344,6 +566,12 @@ namespace ns3 {
 					// else just turn listening on.
 					if (addr == Mac16Address ("ff:ff"))
 						std::get<4>(settings) = false;
+					else
+					{
+						// nothing to send to this neighbour
+						FLEE_MAC_STATS (m_stats.slotsIdle++);
+						FLEE_MAC_STATS (m_slotTrace (addr, std::get<0>(settings), SLOT_IDLE));
+					}
 				}
 			}
 
@@ -351,13 +579,13 @@ namespace ns3 {
 			{
 				NS_LOG_FUNCTION(this << addr << std::get<4>(settings) << (uint32_t)std::get<0>(settings));
 				// prepare receiving slot frequency
-				LrWpanPhyPibAttributes *attributes = new LrWpanPhyPibAttributes ();
-				attributes->phyCurrentChannel = std::get<0>(settings); 
+				Simulator::ScheduleNow (&LrWpanFleeMac::SwitchChannel, this, std::get<0>(settings));
 				// turn RX on when IDLE
-				Simulator::ScheduleNow ( &LrWpanPhy::PlmeSetAttributeRequest, m_phy, LrWpanPibAttributeIdentifier::phyCurrentChannel,attributes);
 				Simulator::ScheduleNow ( &LrWpanMac::SetRxOnWhenIdle, this, true);
 				// prepare timeout
 				Simulator::Schedule (MilliSeconds(5), &LrWpanFleeMac::RxTimeOut, this);
+				FLEE_MAC_STATS (m_stats.slotsRx++);
+				FLEE_MAC_STATS (m_slotTrace (addr, std::get<0>(settings), SLOT_RX));
 			}
 			// turn around TX and RX
 			std::get<4> (settings) = !std::get<4> (settings);
@@ -373,24 +601,463 @@ namespace ns3 {
 	{
 		// save the start of the last packet
 		m_latestStart = MilliSeconds(m_timerLength) - m_timer.GetDelayLeft ();
+		m_latestStartTime = Simulator::Now ();
 		NS_LOG_FUNCTION(this << m_latestStart);
 		LrWpanMac::PdDataStartNotion();
 	}
 
+	void LrWpanFleeMac::PdDataIndication (uint32_t psduLength, Ptr<Packet> p, uint8_t lqi)
+	{
+		LrWpanMacHeader mh;
+		p->PeekHeader (mh);
+		// an announced frame came
+		if (mh.IsData () && mh.GetDstAddrMode () == LrWpanMacHeader::SHORTADDR && mh.GetShortDstAddr () == m_shortAddress)
+			m_expectedFrom.erase (mh.GetShortSrcAddr ());
+		// the sender has more frames for us, keep listening on this link for the rest
+		// of its slot and in the next slot
+		if (mh.IsData () && mh.IsFrmPend () && mh.GetDstAddrMode () == LrWpanMacHeader::SHORTADDR
+				&& mh.GetShortDstAddr () == m_shortAddress)
+		{
+			Address addr = mh.GetShortSrcAddr ();
+			std::map<Address, LinkSpecs >::iterator it = m_connectable.find (addr);
+			// the next frame comes in this slot or the one after it, or the channel lost it;
+			// a sender without a link gets no slot, so it does not block the broadcasts either
+			if (it != m_connectable.end ())
+			{
+				m_expectedFrom[addr] = m_latestStartTime;
+				Simulator::Schedule (m_latestStartTime + MilliSeconds (2*m_broadcastInterval) - Simulator::Now (),
+				                     &LrWpanFleeMac::CheckExpectedFrame, this, addr, std::get<0>(it->second), m_latestStartTime);
+				m_extraSlots.insert (m_latestStartTime);
+			}
+			// the first frame of a burst already reserved the next slot
+			std::set<Time>::const_iterator next = m_extraSlots.upper_bound (Simulator::Now ());
+			bool reserved = next != m_extraSlots.end () && *next < m_latestStartTime + MilliSeconds (m_broadcastInterval);
+			// start listening a bit before the sender starts its slot
+			Time delay = m_latestStartTime + MilliSeconds (m_broadcastInterval - 1) - Simulator::Now ();
+			if (it != m_connectable.end () && !reserved && delay.IsStrictlyPositive () && ClaimExtraSlot (delay, addr))
+				Simulator::Schedule (delay, &LrWpanFleeMac::ScheduleExtraSlot, this, addr, std::get<0>(it->second), 0, false);
+		}
+		LrWpanMac::PdDataIndication (psduLength, p, lqi);
+	}
+
+	void LrWpanFleeMac::ScheduleExtraSlot (const Address& addr, uint8_t channel, uint8_t index, bool tx)
+	{
+		NS_LOG_FUNCTION (this << addr << (uint32_t)channel << (uint32_t)index << tx);
+		m_extraSlots.erase (Simulator::Now ());
+		FLEE_MAC_STATS (m_stats.slotsExtra++);
+		if (!tx)
+		{
+			SwitchChannel (channel);
+			SetRxOnWhenIdle (true);
+			FLEE_MAC_STATS (m_stats.slotsRx++);
+			FLEE_MAC_STATS (m_slotTrace (addr, channel, SLOT_RX));
+		}
+		else if (CheckQueueFor (addr))
+		{
+			SwitchChannel (channel);
+			m_currentTxPkt = m_txPkt;
+			StampSlotStart (m_currentTxPkt);
+			m_txSlotStart = Simulator::Now ();
+			m_txSlotIndex = index;
+			SetFramePending (m_currentTxPkt, HasMoreFrames (addr, index));
+			Simulator::ScheduleNow(&LrWpanFleeMac::ChangeMacState,this,MAC_SENDING);
+			m_setMacState = Simulator::ScheduleNow (&LrWpanPhy::PlmeSetTRXStateRequest, m_phy, IEEE_802_15_4_PHY_TX_ON);
+			FLEE_MAC_STATS (m_stats.slotsTx++);
+			FLEE_MAC_STATS (m_slotTrace (addr, channel, SLOT_TX));
+		}
+		else
+		{
+			FLEE_MAC_STATS (m_stats.slotsIdle++);
+			FLEE_MAC_STATS (m_slotTrace (addr, channel, SLOT_IDLE));
+		}
+	}
+
+	bool LrWpanFleeMac::IsSlotFree (Time delay, const Address& addr) const
+	{
+		// position of the slot in our cycle
+		double start = (MilliSeconds(m_timerLength) - m_timer.GetDelayLeft () + delay).GetSeconds ()*1000;
+		start = fmod (start, m_timerLength);
+		for (std::map<Address, LinkSpecs >::const_iterator it = m_connectable.begin (); it != m_connectable.end (); ++it)
+		{
+			if (it->first == addr)
+				continue;
+			double diff = fmod (start - std::get<1>(it->second) + m_timerLength, m_timerLength);
+			if (diff < m_broadcastInterval || diff > m_timerLength - m_broadcastInterval)
+				return false;
+		}
+		return true;
+	}
+
+	bool LrWpanFleeMac::ClaimExtraSlot (Time delay, const Address& addr)
+	{
+		if (!IsSlotFree (delay, addr))
+			return false;
+		m_extraSlots.insert (Simulator::Now () + delay);
+		return true;
+	}
+
+	void LrWpanFleeMac::SetFramePending (Ptr<Packet> p, bool pending)
+	{
+		LrWpanMacTrailer trailer;
+		p->RemoveTrailer (trailer);
+		LrWpanMacHeader header;
+		p->RemoveHeader (header);
+		if (pending)
+			header.SetFrmPend ();
+		else
+			header.SetNoFrmPend ();
+		p->AddHeader (header);
+		// the header changed, so does the checksum
+		if (Node::ChecksumEnabled ())
+		{
+			trailer.EnableFcs (true);
+			trailer.SetFcs (p);
+		}
+		p->AddTrailer (trailer);
+	}
+
+	bool LrWpanFleeMac::HasMoreFrames (const Address& addr, uint8_t index)
+	{
+		std::map<Address, std::deque<uint32_t> >::const_iterator it = m_queuedFor.find (addr);
+		// the frame that is sent now is still counted
+		if (it == m_queuedFor.end () || it->second.size () <= 1)
+			return false;
+		// the next frame fits in this slot after the current one, with the same header
+		Time slotEnd = m_txSlotStart + MilliSeconds (m_broadcastInterval);
+		uint32_t header = m_currentTxPkt->GetSize () - std::min (m_currentTxPkt->GetSize (), it->second[0]);
+		if (m_burst && Simulator::Now () + GetFrameDuration (m_currentTxPkt) + GetFrameDuration (it->second[1] + header) <= slotEnd)
+			return true;
+		// or the extra slot right after this one is free
+		Time delay = slotEnd - Simulator::Now ();
+		return index < m_maxExtraSlots && delay.IsStrictlyPositive () && IsSlotFree (delay, addr);
+	}
+
+	void LrWpanFleeMac::ContinueBurst (const Address& addr)
+	{
+		NS_LOG_FUNCTION (this << addr);
+		std::map<Address, LinkSpecs >::iterator it = m_connectable.find (addr);
+		if (it == m_connectable.end () || !CheckQueueFor (addr))
+			return;
+		// send the next frame in this slot if it fits, the receiver is still listening
+		if (m_burst && Simulator::Now () + GetFrameDuration (m_txPkt) <= m_txSlotStart + MilliSeconds (m_broadcastInterval))
+		{
+			m_currentTxPkt = m_txPkt;
+			StampSlotStart (m_currentTxPkt);
+			SetFramePending (m_currentTxPkt, HasMoreFrames (addr, m_txSlotIndex));
+			Simulator::ScheduleNow(&LrWpanFleeMac::ChangeMacState,this,MAC_SENDING);
+			m_setMacState = Simulator::ScheduleNow (&LrWpanPhy::PlmeSetTRXStateRequest, m_phy, IEEE_802_15_4_PHY_TX_ON);
+			FLEE_MAC_STATS (m_stats.burstFrames++);
+			return;
+		}
+		// otherwise in an extra slot right after this one
+		Time delay = m_txSlotStart + MilliSeconds (m_broadcastInterval) - Simulator::Now ();
+		if (m_txSlotIndex < m_maxExtraSlots && delay.IsStrictlyPositive () && ClaimExtraSlot (delay, addr))
+			Simulator::Schedule (delay, &LrWpanFleeMac::ScheduleExtraSlot, this, addr, std::get<0>(it->second), m_txSlotIndex + 1, true);
+	}
+
+	Time LrWpanFleeMac::GetFrameDuration (Ptr<const Packet> p) const
+	{
+		return GetFrameDuration (p->GetSize ());
+	}
+
+	Time LrWpanFleeMac::GetFrameDuration (uint32_t size) const
+	{
+		// 2.4 GHz O-QPSK: 32 us per byte plus the 6 byte synchronization header and
+		// PHR, the RX-to-TX turnaround and the wait for the acknowledgment
+		return MicroSeconds ((size + 6) * 32 + 12 * 16 + 54 * 16);
+	}
+
+	void LrWpanFleeMac::StampSlotStart (Ptr<Packet> p)
+	{
+		if (!m_latencyStats)
+			return;
+		LrWpanFleeTimestampTag tag;
+		if (p->RemovePacketTag (tag))
+		{
+			tag.SetSlotStart (Simulator::Now ());
+			p->AddPacketTag (tag);
+		}
+	}
+
 	void LrWpanFleeMac::PruneConnection (const Address& addr)
 	{
 		NS_LOG_FUNCTION (this << addr <<  m_txPkt);
 		NS_LOG_DEBUG ("The connection is lost...");
+		FLEE_MAC_STATS (m_stats.prunes++);
+		FLEE_MAC_STATS (m_pruneTrace (addr));
 		m_connectable.erase(addr);
+		m_linkDelivery.erase(addr);
+		m_linkChanges++;
 		m_txPkt = 0;
 			
 	}
 
+	void LrWpanFleeMac::SweepLinks (void)
+	{
+		// a confirmed link survives 10 silent cycles, a new one only 2
+		std::vector<Address> expired;
+		for (std::map<Address, LinkSpecs >::const_iterator it = m_connectable.begin (); it != m_connectable.end (); ++it)
+		{
+			Time timeout = MilliSeconds ((std::get<3>(it->second) ? 10 : 2)*m_timerLength);
+			if (Simulator::Now () - std::get<5>(it->second) >= timeout)
+				expired.push_back (it->first);
+		}
+		for (std::vector<Address>::const_iterator it = expired.begin (); it != expired.end (); ++it)
+			PruneConnection (*it);
+	}
+
 	void LrWpanFleeMac::IncrementBroadcastChannel (void)
 	{
-		m_broadcastChannel++;
-		if (m_broadcastChannel > 26)
-			m_broadcastChannel = 11;
+		// skip the blacklisted channels and the ones outside our mask, at least one is left
+		do
+		{
+			m_broadcastChannel++;
+			if (m_broadcastChannel > 26)
+				m_broadcastChannel = 11;
+		}
+		while (!IsChannelUsable (m_broadcastChannel));
+	}
+
+	void LrWpanFleeMac::CheckExpectedFrame (const Address& addr, uint8_t channel, Time start)
+	{
+		std::map<Address, Time>::iterator it = m_expectedFrom.find (addr);
+		// a later frame of the neighbour came, or announced frames of its own
+		if (it == m_expectedFrom.end () || it->second != start)
+			return;
+		NS_LOG_DEBUG ("Announced frame of " << addr << " did not come");
+		m_expectedFrom.erase (it);
+		UpdateChannelQuality (channel, false);
+	}
+
+	void LrWpanFleeMac::UpdateChannelQuality (uint8_t channel, bool success)
+	{
+		if (channel < 11 || channel > 26)
+			return;
+		uint8_t i = channel - 11;
+		// a channel that served its time on the blacklist gets a clean slate
+		if (m_blacklistedUntil[i].IsStrictlyPositive () && Simulator::Now () >= m_blacklistedUntil[i])
+		{
+			m_blacklistedUntil[i] = Seconds (0);
+			m_channelQuality[i] = 1.0;
+		}
+		m_channelQuality[i] += m_channelQualityWeight*((success ? 1.0 : 0.0) - m_channelQuality[i]);
+		if (m_channelQuality[i] >= m_blacklistThreshold || IsChannelBlacklisted (channel)
+				|| GetNUsableChannels () <= m_minChannels)
+			return;
+
+		NS_LOG_DEBUG ("Blacklisting channel " << (uint32_t)channel << " at success rate " << m_channelQuality[i]);
+		m_blacklistedUntil[i] = Simulator::Now () + m_blacklistTimeout;
+		FLEE_MAC_STATS (m_stats.channelBlacklists++);
+		if (m_broadcastChannel == channel)
+			IncrementBroadcastChannel ();
+		// drop the links on this channel, they are set up again on a good channel
+		// with the next broadcast we hear from the neighbour
+		std::vector<Address> links;
+		for (std::map<Address, LinkSpecs >::iterator it = m_connectable.begin (); it != m_connectable.end (); ++it)
+			if (std::get<0>(it->second) == channel)
+				links.push_back (it->first);
+		for (std::vector<Address>::iterator it = links.begin (); it != links.end (); ++it)
+			PruneConnection (*it);
+	}
+
+	bool LrWpanFleeMac::IsChannelBlacklisted (uint8_t channel) const
+	{
+		if (channel < 11 || channel > 26)
+			return false;
+		return Simulator::Now () < m_blacklistedUntil[channel - 11];
+	}
+
+	double LrWpanFleeMac::GetChannelQuality (uint8_t channel) const
+	{
+		if (channel < 11 || channel > 26)
+			return 0;
+		return m_channelQuality[channel - 11];
+	}
+
+	uint8_t LrWpanFleeMac::GetNUsableChannels (void) const
+	{
+		uint8_t usable = 0;
+		for (uint8_t channel = 11; channel <= 26; channel++)
+			if (IsChannelUsable (channel))
+				usable++;
+		return usable;
+	}
+
+	bool LrWpanFleeMac::IsChannelUsable (uint8_t channel) const
+	{
+		return channel >= 11 && channel <= 26 && (m_channelMask & (1 << (channel - 11)))
+			&& !IsChannelBlacklisted (channel);
+	}
+
+	uint8_t LrWpanFleeMac::GetSinkRadio (void) const
+	{
+		return m_sinkRadio;
+	}
+
+	uint8_t LrWpanFleeMac::GetNSinkRadios (void) const
+	{
+		return m_sink ? m_nSinkRadios : 1;
+	}
+
+	uint8_t LrWpanFleeMac::GetSinkRadioFor (const Address &addr, uint8_t nRadios)
+	{
+		uint8_t buf[2];
+		Mac16Address::ConvertFrom (addr).CopyTo (buf);
+		return ((buf[0] << 8) | buf[1]) % nRadios;
+	}
+
+	bool LrWpanFleeMac::HasLink (const Address &addr) const
+	{
+		return m_connectable.find (addr) != m_connectable.end ();
+	}
+
+	uint32_t LrWpanFleeMac::GetLinkChanges (void) const
+	{
+		return m_linkChanges;
+	}
+
+	bool LrWpanFleeMac::IsServedBySibling (const Address &addr) const
+	{
+		return GetNSinkRadios () > 1 && GetSinkRadioFor (addr, m_nSinkRadios) != m_sinkRadio;
+	}
+
+	void LrWpanFleeMac::SwitchChannel (uint8_t channel)
+	{
+		LrWpanPhyPibAttributes attributes;
+		attributes.phyCurrentChannel = channel;
+		m_phy->PlmeSetAttributeRequest (LrWpanPibAttributeIdentifier::phyCurrentChannel,&attributes);
+		// move us to the receiver set of the new channel
+		if (m_gridChannel)
+			m_gridChannel->NotifyChannelChange (m_phy, channel);
+	}
+
+	int64_t LrWpanFleeMac::AssignStreams (int64_t stream)
+	{
+		NS_LOG_FUNCTION (this << stream);
+		m_var->SetStream (stream);
+		return 1;
+	}
+
+	const LrWpanFleeMacStats& LrWpanFleeMac::GetStats (void) const
+	{
+		return m_stats;
+	}
+
+	void LrWpanFleeMac::ResetStats (void)
+	{
+		m_stats = LrWpanFleeMacStats ();
+		m_queueLatency.Reset ();
+		m_txLatency.Reset ();
+		m_deliveryLatency.clear ();
+	}
+
+	const LrWpanFleeLatencyHistogram& LrWpanFleeMac::GetQueueLatency (void) const
+	{
+		return m_queueLatency;
+	}
+
+	const LrWpanFleeLatencyHistogram& LrWpanFleeMac::GetTxLatency (void) const
+	{
+		return m_txLatency;
+	}
+
+	const LrWpanFleeLatencyHistogram& LrWpanFleeMac::GetDeliveryLatency (uint8_t hops) const
+	{
+		static const LrWpanFleeLatencyHistogram empty;
+		if (hops >= m_deliveryLatency.size ())
+			return empty;
+		return m_deliveryLatency[hops];
+	}
+
+	uint8_t LrWpanFleeMac::GetMaxDeliveryHops (void) const
+	{
+		return m_deliveryLatency.size ();
+	}
+
+	double LrWpanFleeMac::GetLinkSuccessRate (const Address &addr) const
+	{
+		std::map<Address, double>::const_iterator it = m_linkDelivery.find (addr);
+		if (it == m_linkDelivery.end ())
+			return 1.0;
+		return it->second;
+	}
+
+	double LrWpanFleeMac::GetLinkEtx (const Address &addr) const
+	{
+		// a dead link still gets a finite cost, so path costs can be added up
+		return 1.0 / std::max (GetLinkSuccessRate (addr), 1.0 / FLEE_MAX_LINK_ETX);
+	}
+
+	void LrWpanFleeMac::SaveState (std::ostream &os) const
+	{
+		// time until the next cycle starts
+		Time phase = m_timer.IsRunning () ? m_timer.GetDelayLeft () : Simulator::GetDelayLeft (m_startEvent);
+		WriteState<int64_t> (os, phase.GetNanoSeconds ());
+		WriteState<uint8_t> (os, m_broadcastChannel);
+		WriteState<uint8_t> (os, (bool) m_canTx);
+		for (uint8_t i = 0; i < 16; i++)
+		{
+			WriteState<double> (os, m_channelQuality[i]);
+			Time blacklisted = std::max (m_blacklistedUntil[i] - Simulator::Now (), Seconds (0));
+			WriteState<int64_t> (os, blacklisted.GetNanoSeconds ());
+		}
+		WriteState<uint32_t> (os, m_connectable.size ());
+		for (std::map<Address, LinkSpecs >::const_iterator it = m_connectable.begin (); it != m_connectable.end (); ++it)
+		{
+			uint8_t buf[2];
+			Mac16Address::ConvertFrom (it->first).CopyTo (buf);
+			os.write ((const char *) buf, 2);
+			WriteState<uint8_t> (os, std::get<0>(it->second));
+			WriteState<double> (os, std::get<1>(it->second));
+			WriteState<uint8_t> (os, std::get<2>(it->second));
+			WriteState<uint8_t> (os, std::get<3>(it->second));
+			WriteState<uint8_t> (os, std::get<4>(it->second));
+			std::map<Address, double>::const_iterator link = m_linkDelivery.find (it->first);
+			WriteState<double> (os, link == m_linkDelivery.end () ? -1.0 : link->second);
+		}
+	}
+
+	void LrWpanFleeMac::RestoreState (std::istream &is)
+	{
+		NS_LOG_FUNCTION (this);
+		// continue the cycle at the phase it had
+		Time phase = NanoSeconds (ReadState<int64_t> (is));
+		Simulator::Cancel (m_startEvent);
+		m_timer.Cancel ();
+		m_startEvent = Simulator::Schedule (phase, &LrWpanFleeMac::EndTimer, this);
+		m_broadcastChannel = ReadState<uint8_t> (is);
+		m_canTx = ReadState<uint8_t> (is);
+		for (uint8_t i = 0; i < 16; i++)
+		{
+			m_channelQuality[i] = ReadState<double> (is);
+			int64_t blacklisted = ReadState<int64_t> (is);
+			m_blacklistedUntil[i] = blacklisted > 0 ? Simulator::Now () + NanoSeconds (blacklisted) : Seconds (0);
+		}
+		m_connectable.clear ();
+		m_linkDelivery.clear ();
+		uint32_t n = ReadState<uint32_t> (is);
+		for (uint32_t i = 0; i < n && is; i++)
+		{
+			uint8_t buf[2];
+			is.read ((char *) buf, 2);
+			Mac16Address neighbour;
+			neighbour.CopyFrom (buf);
+			uint8_t channel = ReadState<uint8_t> (is);
+			double offset = ReadState<double> (is);
+			uint8_t missed = ReadState<uint8_t> (is);
+			bool connected = ReadState<uint8_t> (is);
+			bool inTx = ReadState<uint8_t> (is);
+			double delivery = ReadState<double> (is);
+			m_connectable[neighbour] = std::make_tuple (channel, offset, missed, connected, inTx, Simulator::Now (), ++m_linkGeneration);
+			if (delivery >= 0)
+				m_linkDelivery[neighbour] = delivery;
+		}
+		// listen on the restored broadcast channel until the cycle starts
+		if (!IsChannelUsable (m_broadcastChannel))
+			IncrementBroadcastChannel ();
+		m_channelNumber = m_broadcastChannel;
+		SwitchChannel (m_channelNumber);
+		m_linkChanges++;
 	}
 
 	void LrWpanFleeMac::SetBroadcastChannel (uint8_t channel)
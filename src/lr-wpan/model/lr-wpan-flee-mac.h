@@ -27,8 +27,27 @@
 #include <ns3/lr-wpan-mac.h>
 #include <ns3/lr-wpan-phy.h>
 #include <ns3/timer.h>
-#include <ns3/watchdog.h>
+#include <ns3/traced-value.h>
+#include <ns3/traced-callback.h>
+#include <ns3/lr-wpan-flee-latency-histogram.h>
+#include <deque>
 #include <map>
+#include <vector>
+#include <iosfwd>
+#include <set>
+
+// The slot counters and their trace sources cost an increment and a check of
+// an empty callback list on every slot.  Define NS3_FLEE_MAC_NO_STATS to
+// compile them out completely.
+#ifndef NS3_FLEE_MAC_NO_STATS
+#define FLEE_MAC_STATS(x) x
+#else
+#define FLEE_MAC_STATS(x)
+#endif
+
+// Highest ETX a link can get, a link without a single acknowledged frame
+// still has a finite cost.
+#define FLEE_MAX_LINK_ETX 20.0
 
 
 namespace ns3 {
@@ -36,6 +55,7 @@ namespace ns3 {
 class Packet;
 class LrWpanCsmaCa;
 class UniformRandomVariable;
+class LrWpanGridSpectrumChannel;
 
 /**
  * \defgroup lr-wpan LR-WPAN models
@@ -50,6 +70,24 @@ class UniformRandomVariable;
  */
 
 
+/**
+ * \ingroup lr-wpan
+ *
+ * Counters of the FLEE slot scheduler, see LrWpanFleeMac::GetStats.
+ */
+struct LrWpanFleeMacStats
+{
+  uint64_t slotsScheduled;       //!< slots scheduled at the start of a cycle
+  uint64_t slotsTx;              //!< slots in which a frame was sent
+  uint64_t slotsRx;              //!< slots in which the radio listened
+  uint64_t slotsIdle;            //!< slots left unused
+  uint64_t slotsExtra;           //!< extra slots granted to a backlogged link
+  uint64_t burstFrames;          //!< frames sent after another one in the same slot
+  uint64_t prunes;               //!< neighbours dropped by PruneConnection
+  uint64_t channelBlacklists;    //!< channels put on the blacklist
+  uint64_t broadcastCopies[16];  //!< broadcast frames sent on channel 11 + i
+};
+
 /**
  * \ingroup lr-wpan
  *
@@ -57,11 +95,15 @@ class UniformRandomVariable;
  */
 class LrWpanFleeMac : public LrWpanMac
 {
+	// tests and benchmarks drive the slot scheduler directly
+	friend class LrWpanFleeMacTestAccess;
 public:
 	// set the broadcast channel;
 	void SetBroadcastChannel (uint8_t channel);
-	// typedef for our database 
-	typedef std::tuple <uint8_t, double, uint8_t, bool,bool, Watchdog*> LinkSpecs;
+	// typedef for our database: channel, offset in the cycle in ms, missed slots,
+	// confirmed by the neighbour, our turn to transmit, the last time we heard of it
+	// and the generation of the link, which changes whenever it is set up or moves
+	typedef std::tuple <uint8_t, double, uint8_t, bool,bool, Time, uint32_t> LinkSpecs;
   /**
    * Get the type ID.
    *
@@ -76,6 +118,8 @@ public:
   ~LrWpanFleeMac (void);
 	// finidsh constructing object
 	void DoInitialize ();
+	// drop the frames we still expect from neighbours
+	void DoDispose ();
 	// overwrite of deleting elements
   void RemoveFirstTxQElement ();
 	// get request for parameters of the PHY layer
@@ -92,6 +136,158 @@ public:
 		* Indicates the start of an MPDU at PHY (receiving)
 		*/
   void PdDataStartNotion (void);
+	/**
+	 * Interception of a received frame, to see if the sender has more frames
+	 * for us and wants an extra slot.
+	 *
+	 * \param psduLength number of bytes in the PSDU
+	 * \param p the packet to be transmitted
+	 * \param lqi Link quality (LQI) value measured during reception of the PPDU
+	 */
+	void PdDataIndication (uint32_t psduLength, Ptr<Packet> p, uint8_t lqi);
+	/**
+	 * Assign a fixed random variable stream number to the random variables
+	 * used by this model (the randomized start of the slot cycle).
+	 *
+	 * \param stream first stream index to use
+	 * \return the number of stream indices assigned by this model
+	 */
+	int64_t AssignStreams (int64_t stream);
+
+	// the way a slot was used
+	enum SlotUse
+	{
+		SLOT_TX,
+		SLOT_RX,
+		SLOT_IDLE
+	};
+	/**
+	 * TracedCallback signature for the use of a slot.
+	 *
+	 * \param [in] addr the neighbour of the slot, ff:ff for broadcast slots
+	 * \param [in] channel the channel of the slot
+	 * \param [in] use how the slot was used
+	 */
+	typedef void (* SlotTracedCallback)(const Address &addr, uint8_t channel, SlotUse use);
+	/**
+	 * TracedCallback signature for a pruned neighbour.
+	 *
+	 * \param [in] addr the neighbour that was dropped
+	 */
+	typedef void (* PruneTracedCallback)(const Address &addr);
+	/**
+	 * TracedCallback signature for a broadcast copy that is sent.
+	 *
+	 * \param [in] channel the channel of the copy
+	 */
+	typedef void (* BroadcastCopyTracedCallback)(uint8_t channel);
+
+	// get the slot counters, they stay zero if compiled with NS3_FLEE_MAC_NO_STATS
+	const LrWpanFleeMacStats& GetStats (void) const;
+	// clear the slot counters and the latency histograms
+	void ResetStats (void);
+	/**
+	 * Get the time the frames sent by this MAC waited in its queue for their
+	 * slot.  Only collected with LatencyStats enabled.
+	 *
+	 * \return the histogram of the queueing delays
+	 */
+	const LrWpanFleeLatencyHistogram& GetQueueLatency (void) const;
+	/**
+	 * Get the time from the start of the slot until a frame sent by this MAC
+	 * was confirmed, including the retransmissions.  Only collected with
+	 * LatencyStats enabled.
+	 *
+	 * \return the histogram of the transmission delays
+	 */
+	const LrWpanFleeLatencyHistogram& GetTxLatency (void) const;
+	/**
+	 * Get the delay of the frames received by this MAC since they entered the
+	 * queue of the first FLEE MAC, per number of hops they made.  Only
+	 * collected with LatencyStats enabled.
+	 *
+	 * \param hops the number of hops
+	 * \return the histogram of the delays, empty if no frame made that many hops
+	 */
+	const LrWpanFleeLatencyHistogram& GetDeliveryLatency (uint8_t hops) const;
+	/**
+	 * \return one more than the largest number of hops GetDeliveryLatency has samples for
+	 */
+	uint8_t GetMaxDeliveryHops (void) const;
+	/**
+	 * Get the moving average of the fraction of unicast frames to a neighbour
+	 * that were acknowledged.
+	 *
+	 * \param addr the short address of the neighbour
+	 * \return the success rate, 1 for neighbours we never sent to
+	 */
+	double GetLinkSuccessRate (const Address &addr) const;
+	/**
+	 * Get the expected transmission count (ETX) of the link to a neighbour,
+	 * the inverse of its success rate.
+	 *
+	 * \param addr the short address of the neighbour
+	 * \return the ETX, between 1 and FLEE_MAX_LINK_ETX
+	 */
+	double GetLinkEtx (const Address &addr) const;
+	/**
+	 * Get the moving average of the success rate on a channel, from the
+	 * acknowledgments of our unicast frames and the frames we receive.
+	 *
+	 * \param channel the channel, 11 to 26
+	 * \return the success rate
+	 */
+	double GetChannelQuality (uint8_t channel) const;
+	/**
+	 * \param channel the channel, 11 to 26
+	 * \return true if the channel is skipped by the broadcast rotation and links
+	 */
+	bool IsChannelBlacklisted (uint8_t channel) const;
+	/**
+	 * \return the index of this radio among the radios of its sink
+	 */
+	uint8_t GetSinkRadio (void) const;
+	/**
+	 * \return the number of radios of the sink this radio belongs to, 1 if it is not a sink radio
+	 */
+	uint8_t GetNSinkRadios (void) const;
+	/**
+	 * Get the radio of a sink that serves a neighbour.  The children are dealt
+	 * out by short address, so every radio serves about as many.
+	 *
+	 * \param addr the short address of the neighbour
+	 * \param nRadios the number of radios of the sink
+	 * \return the index of the radio that serves the neighbour
+	 */
+	static uint8_t GetSinkRadioFor (const Address &addr, uint8_t nRadios);
+	/**
+	 * \param addr the short address of a neighbour
+	 * \return true if there is a link to the neighbour
+	 */
+	bool HasLink (const Address &addr) const;
+	/**
+	 * Get the number of times a link was added, confirmed, moved to another
+	 * channel or pruned.  The neighbour table did not change as long as the
+	 * number stays the same.
+	 *
+	 * \return the number of changes to the neighbour table
+	 */
+	uint32_t GetLinkChanges (void) const;
+	/**
+	 * Write the neighbour table, the link and channel statistics and the
+	 * phase of the slot cycle to a checkpoint.  Queued frames are not saved.
+	 *
+	 * \param os the stream to write to
+	 */
+	void SaveState (std::ostream &os) const;
+	/**
+	 * Replace the neighbour table and statistics by the ones of a checkpoint,
+	 * and restart the slot cycle at the saved phase.  Call it after the MAC is
+	 * initialized.
+	 *
+	 * \param is the stream to read from
+	 */
+	void RestoreState (std::istream &is);
 private:
 	// current channel
 	uint8_t m_channelNumber;
@@ -115,10 +311,15 @@ private:
 	// time is in miliseconds.
 	double m_timerLength;
 	Timer m_timer;
-	// defines if this device is a sink. That one gets less receive slots...
+	// defines if this device is a radio of a sink, it leaves the neighbours of the other radios alone
 	bool m_sink; 
+	// index of this radio among the radios of the sink, and their number
+	uint8_t m_sinkRadio;
+	uint8_t m_nSinkRadios;
+	// channels this radio may use, bit i for channel 11 + i
+	uint32_t m_channelMask;
 	// boolean to suppress transmissions for one cycle
-	bool m_canTx;
+	TracedValue<bool> m_canTx;
 	// how often the device broadcasts with a broadcast message
 	double m_broadcastInterval;
 	// next broadcast channel
@@ -129,18 +330,106 @@ private:
 	Time m_latestStart;
 	// random variable
 	Ptr<UniformRandomVariable> m_var;
+	// randomized start of the first cycle
+	EventId m_startEvent;
 	// Reset the timer.
 	void EndTimer (void);
 	// Schedule the slots in this rotation based on neighbours
 	void ScheduleSlots (void);
 	// amount of neighbours
 	uint8_t m_neighbours;
-	// Schedule a transmission for either reception or transmission.
-	void ScheduleSlot (const Address& addr);
+	// Schedule a transmission for either reception or transmission, a link slot only runs
+	// if the link still has the generation it had when the slot was scheduled
+	void ScheduleSlot (const Address& addr, uint32_t generation);
+	// last generation given to a link
+	uint32_t m_linkGeneration;
 	// if the request is not acked, remove the connection, because something went wrong.
 	void PruneConnection (const Address& addr);
+	// prune the links that timed out, called at the end of every cycle
+	void SweepLinks (void);
 	// incremement the channel of broadcast 
 	void IncrementBroadcastChannel (void);
+	// add a success or failure to the average of a channel, and blacklist it if it got too poor
+	void UpdateChannelQuality (uint8_t channel, bool success);
+	// count a failure on the channel if the frame a neighbour announced at start never came
+	void CheckExpectedFrame (const Address& addr, uint8_t channel, Time start);
+	// number of channels that are not blacklisted
+	uint8_t GetNUsableChannels (void) const;
+	// whether a channel is in our mask and not blacklisted
+	bool IsChannelUsable (uint8_t channel) const;
+	// whether another radio of this sink serves the neighbour
+	bool IsServedBySibling (const Address &addr) const;
+	// tune the PHY to another channel and tell the spectrum channel about it
+	void SwitchChannel (uint8_t channel);
+	// use an extra slot right after the slot of a backlogged link, index counts the extra slots
+	void ScheduleExtraSlot (const Address& addr, uint8_t channel, uint8_t index, bool tx);
+	// whether a slot after a delay overlaps no slot of a neighbour other than addr
+	bool IsSlotFree (Time delay, const Address& addr) const;
+	// reserve an extra slot after a delay, false if it would overlap a neighbour slot
+	bool ClaimExtraSlot (Time delay, const Address& addr);
+	// mark whether more frames follow the one that is sent
+	void SetFramePending (Ptr<Packet> p, bool pending);
+	// whether another frame for the neighbour follows in this slot or an extra one
+	bool HasMoreFrames (const Address& addr, uint8_t index);
+	// after an acknowledged frame, send the next one to the neighbour in this slot or an extra one
+	void ContinueBurst (const Address& addr);
+	// time a frame and its acknowledgment take on the air
+	Time GetFrameDuration (Ptr<const Packet> p) const;
+	// time a frame of size bytes and its acknowledgment take on the air
+	Time GetFrameDuration (uint32_t size) const;
+	// note in the timestamp tag that the frame starts its slot
+	void StampSlotStart (Ptr<Packet> p);
+	// spectrum channel that keeps per-channel receiver sets, if any
+	Ptr<LrWpanGridSpectrumChannel> m_gridChannel;
+	// slot counters
+	LrWpanFleeMacStats m_stats;
+	// tag the frames with LrWpanFleeTimestampTag and fill the histograms below
+	bool m_latencyStats;
+	// time from the enqueue until the slot of the frames we sent
+	LrWpanFleeLatencyHistogram m_queueLatency;
+	// time from the slot start until the confirm of the frames we sent
+	LrWpanFleeLatencyHistogram m_txLatency;
+	// delay since the first enqueue of the frames we received, per hop count
+	std::vector<LrWpanFleeLatencyHistogram> m_deliveryLatency;
+	// moving average of the acknowledged unicast frames per neighbour
+	std::map<Address, double> m_linkDelivery;
+	// number of changes to m_connectable
+	uint32_t m_linkChanges;
+	// weight of the newest outcome in m_linkDelivery
+	double m_etxWeight;
+	// moving average of the success rate per channel, index 0 is channel 11
+	double m_channelQuality[16];
+	// weight of the newest outcome in m_channelQuality
+	double m_channelQualityWeight;
+	// end of the blacklisting per channel
+	Time m_blacklistedUntil[16];
+	// channels below this success rate are blacklisted
+	double m_blacklistThreshold;
+	// time a channel stays on the blacklist
+	Time m_blacklistTimeout;
+	// number of channels that are never blacklisted
+	uint8_t m_minChannels;
+	// payload sizes of the queued unicast frames per neighbour, in sending order
+	std::map<Address, std::deque<uint32_t> > m_queuedFor;
+	// maximum number of extra slots after the slot of a link in one cycle
+	uint8_t m_maxExtraSlots;
+	// send several frames to a neighbour in one slot
+	bool m_burst;
+	// start of the slots that are reserved for a backlogged link, broadcast slots give way to them
+	std::set<Time> m_extraSlots;
+	// start of the slot in which the current frame is sent, and its index in the extra slots
+	Time m_txSlotStart;
+	uint8_t m_txSlotIndex;
+	// start of the last received frame
+	Time m_latestStartTime;
+	// start of the last frame of every neighbour that announced more frames for us
+	std::map<Address, Time> m_expectedFrom;
+	// trace source fired for every slot
+	TracedCallback<const Address &, uint8_t, SlotUse> m_slotTrace;
+	// trace source fired for every pruned neighbour
+	TracedCallback<const Address &> m_pruneTrace;
+	// trace source fired for every broadcast copy that is sent
+	TracedCallback<uint8_t> m_broadcastCopyTrace;
 };
 
 
@@ -0,0 +1,218 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-flee-profiler.h"
+
+#ifdef NS3_FLEE_PROFILE
+
+#include <ns3/simulator.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace ns3 {
+
+namespace {
+
+/// calls and ticks of one zone, summed over the threads
+struct ZoneTotal
+{
+  uint64_t calls;  //!< number of times the zone was entered
+  uint64_t ticks;  //!< ticks spent in the zone
+};
+
+/**
+ * \brief Calls and ticks of one zone in one thread.
+ *
+ * Only the owning thread adds to them, but Dump reads and clears them from
+ * the thread that destroys the simulator, so they are relaxed atomics.
+ */
+struct ZoneCounter
+{
+  ZoneCounter ()
+    : calls (0),
+      ticks (0)
+  {
+  }
+  /// only copied when the owning thread grows its counters, with g_lock held
+  ZoneCounter (const ZoneCounter &o)
+    : calls (o.calls.load (std::memory_order_relaxed)),
+      ticks (o.ticks.load (std::memory_order_relaxed))
+  {
+  }
+  std::atomic<uint64_t> calls;  //!< number of times the zone was entered
+  std::atomic<uint64_t> ticks;  //!< ticks spent in the zone
+};
+
+/// the counters of one thread, indexed on zone
+typedef std::vector<ZoneCounter> ThreadCounters;
+
+std::mutex g_lock;                           //!< guards everything below but g_armed
+std::vector<std::string> g_names;            //!< name of every zone
+std::vector<ThreadCounters *> g_threads;     //!< counters of every thread
+std::atomic<bool> g_armed (false);           //!< true if a dump is scheduled, read without g_lock
+uint64_t g_startTicks = 0;                   //!< ticks at the start of the profile
+std::chrono::steady_clock::time_point g_startTime; //!< wall time at the start of the profile
+
+thread_local ThreadCounters *t_counters = 0; //!< counters of this thread
+
+/**
+ * \brief Restart the profile interval, called with g_lock held.
+ */
+void
+Restart (void)
+{
+  g_startTicks = FleeProfiler::Now ();
+  g_startTime = std::chrono::steady_clock::now ();
+}
+
+} // anonymous namespace
+
+uint32_t
+FleeProfiler::RegisterZone (const char *name)
+{
+  std::lock_guard<std::mutex> guard (g_lock);
+  if (g_names.empty ())
+    {
+      Restart ();
+    }
+  g_names.push_back (name);
+  return g_names.size () - 1;
+}
+
+uint64_t
+FleeProfiler::Now (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+  return __rdtsc ();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds> (
+    std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+#endif
+}
+
+void
+FleeProfiler::Add (uint32_t zone, uint64_t ticks)
+{
+  if (t_counters == 0 || t_counters->size () <= zone || !g_armed.load (std::memory_order_relaxed))
+    {
+      std::lock_guard<std::mutex> guard (g_lock);
+      if (t_counters == 0)
+        {
+          // never freed, the thread may end before the profile is printed
+          t_counters = new ThreadCounters ();
+          g_threads.push_back (t_counters);
+        }
+      if (t_counters->size () < g_names.size ())
+        {
+          t_counters->resize (g_names.size ());
+        }
+      if (!g_armed.load (std::memory_order_relaxed))
+        {
+          g_armed.store (true, std::memory_order_relaxed);
+          Simulator::ScheduleDestroy (&FleeProfiler::Dump);
+        }
+    }
+  ZoneCounter &counter = (*t_counters)[zone];
+  counter.calls.fetch_add (1, std::memory_order_relaxed);
+  counter.ticks.fetch_add (ticks, std::memory_order_relaxed);
+}
+
+void
+FleeProfiler::Dump (void)
+{
+  std::lock_guard<std::mutex> guard (g_lock);
+  g_armed.store (false, std::memory_order_relaxed);
+
+  double wallNs = std::chrono::duration_cast<std::chrono::nanoseconds> (
+    std::chrono::steady_clock::now () - g_startTime).count ();
+  uint64_t ticks = Now () - g_startTicks;
+  double nsPerTick = (ticks > 0) ? wallNs / ticks : 1.0;
+
+  // sum the threads and clear them for the next simulation
+  std::vector<ZoneTotal> total (g_names.size (), ZoneTotal ());
+  for (std::vector<ThreadCounters *>::iterator t = g_threads.begin (); t != g_threads.end (); ++t)
+    {
+      for (uint32_t zone = 0; zone < (*t)->size (); zone++)
+        {
+          total[zone].calls += (**t)[zone].calls.exchange (0, std::memory_order_relaxed);
+          total[zone].ticks += (**t)[zone].ticks.exchange (0, std::memory_order_relaxed);
+        }
+    }
+
+  // zones of the same name, e.g. from an inlined function, are merged
+  std::vector<std::pair<uint64_t, std::string> > order;
+  std::vector<std::string> names;
+  std::vector<ZoneTotal> merged;
+  for (uint32_t zone = 0; zone < g_names.size (); zone++)
+    {
+      std::vector<std::string>::iterator it = std::find (names.begin (), names.end (), g_names[zone]);
+      if (it == names.end ())
+        {
+          names.push_back (g_names[zone]);
+          merged.push_back (total[zone]);
+        }
+      else
+        {
+          merged[it - names.begin ()].calls += total[zone].calls;
+          merged[it - names.begin ()].ticks += total[zone].ticks;
+        }
+    }
+  for (uint32_t i = 0; i < names.size (); i++)
+    {
+      order.push_back (std::make_pair (merged[i].ticks, names[i]));
+    }
+  std::sort (order.rbegin (), order.rend ());
+
+  std::clog << "% FLEE profile over " << wallNs / 1e9 << " s wall time" << std::endl;
+  std::clog << std::setiosflags (std::ios::left) << std::setw (32) << "% zone"
+            << std::resetiosflags (std::ios::left)
+            << std::setw (12) << "calls" << std::setw (14) << "total[ms]"
+            << std::setw (12) << "avg[ns]" << std::setw (9) << "wall[%]" << std::endl;
+  for (std::vector<std::pair<uint64_t, std::string> >::const_iterator it = order.begin (); it != order.end (); ++it)
+    {
+      const ZoneTotal &counter = merged[std::find (names.begin (), names.end (), it->second) - names.begin ()];
+      if (counter.calls == 0)
+        {
+          continue;
+        }
+      double ns = counter.ticks * nsPerTick;
+      std::clog << std::setiosflags (std::ios::left) << std::setw (32) << it->second
+                << std::resetiosflags (std::ios::left)
+                << std::setw (12) << counter.calls
+                << std::setw (14) << std::fixed << std::setprecision (3) << ns / 1e6
+                << std::setw (12) << std::setprecision (1) << ns / counter.calls
+                << std::setw (9) << std::setprecision (2) << 100 * ns / wallNs << std::endl;
+    }
+  std::clog.unsetf (std::ios::fixed);
+  Restart ();
+}
+
+} // namespace ns3
+
+#endif /* NS3_FLEE_PROFILE */
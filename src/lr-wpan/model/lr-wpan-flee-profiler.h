@@ -0,0 +1,116 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_FLEE_PROFILER_H
+#define LR_WPAN_FLEE_PROFILER_H
+
+#include <stdint.h>
+
+/**
+ * \ingroup lr-wpan
+ *
+ * Mark the rest of the enclosing scope as a profiling zone.  The time spent
+ * in the scope is added to the zone with the given name, and a flat profile
+ * of all zones is printed to std::clog at Simulator::Destroy.  Unless
+ * NS3_FLEE_PROFILE is defined the macro expands to nothing.
+ *
+ * \param name a string literal naming the zone
+ */
+#ifdef NS3_FLEE_PROFILE
+#define FLEE_PROFILE_ZONE(name)                                                 \
+  static const uint32_t fleeProfileZoneId = ns3::FleeProfiler::RegisterZone (name); \
+  ns3::FleeProfileScope fleeProfileScope (fleeProfileZoneId)
+#else
+#define FLEE_PROFILE_ZONE(name)
+#endif
+
+#ifdef NS3_FLEE_PROFILE
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Accumulates the time spent in the profiling zones.
+ *
+ * Every thread adds to its own counters, the profile is summed over all
+ * threads when it is printed.  Time is read from the time stamp counter on
+ * x86 and calibrated against std::chrono::steady_clock, other platforms read
+ * steady_clock directly.
+ */
+class FleeProfiler
+{
+public:
+  /**
+   * \brief Register a zone, called once per FLEE_PROFILE_ZONE.
+   * \param name the name of the zone
+   * \return the index of the zone
+   */
+  static uint32_t RegisterZone (const char *name);
+
+  /**
+   * \return the current tick count
+   */
+  static uint64_t Now (void);
+
+  /**
+   * \brief Add one call of a zone to the counters of this thread.
+   * \param zone the index of the zone
+   * \param ticks the ticks spent in the zone
+   */
+  static void Add (uint32_t zone, uint64_t ticks);
+
+  /**
+   * \brief Print the flat profile and clear the counters.
+   */
+  static void Dump (void);
+};
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Measures the lifetime of a scope into a profiling zone.
+ */
+class FleeProfileScope
+{
+public:
+  /**
+   * \param zone the index of the zone
+   */
+  explicit FleeProfileScope (uint32_t zone)
+    : m_zone (zone),
+      m_start (FleeProfiler::Now ())
+  {
+  }
+  ~FleeProfileScope ()
+  {
+    FleeProfiler::Add (m_zone, FleeProfiler::Now () - m_start);
+  }
+
+private:
+  uint32_t m_zone;   //!< the zone to add to
+  uint64_t m_start;  //!< ticks at the start of the scope
+};
+
+} // namespace ns3
+
+#endif /* NS3_FLEE_PROFILE */
+
+#endif /* LR_WPAN_FLEE_PROFILER_H */
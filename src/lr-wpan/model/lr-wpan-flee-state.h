@@ -0,0 +1,66 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_FLEE_STATE_H
+#define LR_WPAN_FLEE_STATE_H
+
+#include <istream>
+#include <ostream>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Write a value to a FLEE checkpoint.
+ *
+ * Checkpoints are read back on the same machine, so values are stored in
+ * host byte order.
+ *
+ * \param os the checkpoint
+ * \param value the value
+ */
+template <typename T>
+inline void
+WriteState (std::ostream &os, T value)
+{
+  os.write ((const char *) &value, sizeof (T));
+}
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Read a value written by WriteState from a FLEE checkpoint.
+ *
+ * \param is the checkpoint
+ * \return the value, or a default value if the checkpoint ended
+ */
+template <typename T>
+inline T
+ReadState (std::istream &is)
+{
+  T value = T ();
+  is.read ((char *) &value, sizeof (T));
+  return value;
+}
+
+} // namespace ns3
+
+#endif /* LR_WPAN_FLEE_STATE_H */
@@ -0,0 +1,146 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-flee-timestamp-tag.h"
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (LrWpanFleeTimestampTag);
+
+TypeId
+LrWpanFleeTimestampTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LrWpanFleeTimestampTag")
+    .SetParent<Tag> ()
+    .SetGroupName ("LrWpan")
+    .AddConstructor<LrWpanFleeTimestampTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+LrWpanFleeTimestampTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+LrWpanFleeTimestampTag::LrWpanFleeTimestampTag ()
+  : m_origin (0),
+    m_enqueue (0),
+    m_slotStart (0),
+    m_hops (0),
+    m_control (0)
+{
+}
+
+void
+LrWpanFleeTimestampTag::SetOrigin (Time origin)
+{
+  m_origin = origin.GetNanoSeconds ();
+}
+
+Time
+LrWpanFleeTimestampTag::GetOrigin (void) const
+{
+  return NanoSeconds (m_origin);
+}
+
+void
+LrWpanFleeTimestampTag::SetEnqueue (Time enqueue)
+{
+  m_enqueue = enqueue.GetNanoSeconds ();
+}
+
+Time
+LrWpanFleeTimestampTag::GetEnqueue (void) const
+{
+  return NanoSeconds (m_enqueue);
+}
+
+void
+LrWpanFleeTimestampTag::SetSlotStart (Time slotStart)
+{
+  m_slotStart = slotStart.GetNanoSeconds ();
+}
+
+Time
+LrWpanFleeTimestampTag::GetSlotStart (void) const
+{
+  return NanoSeconds (m_slotStart);
+}
+
+void
+LrWpanFleeTimestampTag::SetHops (uint8_t hops)
+{
+  m_hops = hops;
+}
+
+uint8_t
+LrWpanFleeTimestampTag::GetHops (void) const
+{
+  return m_hops;
+}
+
+void
+LrWpanFleeTimestampTag::SetControl (bool control)
+{
+  m_control = control;
+}
+
+bool
+LrWpanFleeTimestampTag::IsControl (void) const
+{
+  return m_control;
+}
+
+uint32_t
+LrWpanFleeTimestampTag::GetSerializedSize (void) const
+{
+  return 3 * sizeof (int64_t) + 2 * sizeof (uint8_t);
+}
+
+void
+LrWpanFleeTimestampTag::Serialize (TagBuffer i) const
+{
+  i.WriteU64 (m_origin);
+  i.WriteU64 (m_enqueue);
+  i.WriteU64 (m_slotStart);
+  i.WriteU8 (m_hops);
+  i.WriteU8 (m_control);
+}
+
+void
+LrWpanFleeTimestampTag::Deserialize (TagBuffer i)
+{
+  m_origin = i.ReadU64 ();
+  m_enqueue = i.ReadU64 ();
+  m_slotStart = i.ReadU64 ();
+  m_hops = i.ReadU8 ();
+  m_control = i.ReadU8 ();
+}
+
+void
+LrWpanFleeTimestampTag::Print (std::ostream &os) const
+{
+  os << "origin=" << m_origin << "ns enqueue=" << m_enqueue << "ns slotStart="
+     << m_slotStart << "ns hops=" << (uint32_t) m_hops << " control=" << (uint32_t) m_control;
+}
+
+} // namespace ns3
@@ -0,0 +1,112 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_FLEE_TIMESTAMP_TAG_H
+#define LR_WPAN_FLEE_TIMESTAMP_TAG_H
+
+#include <ns3/tag.h>
+#include <ns3/nstime.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Packet tag with the times a packet spent in the FLEE MACs
+ *
+ * Added by an LrWpanFleeMac with LatencyStats enabled when the packet
+ * enters its first queue, and updated at every hop: the enqueue time when
+ * a MAC queues it, the slot start when a MAC starts sending it and the
+ * hop count when a MAC receives it.  The origin time stays, so the delay
+ * since the packet entered the network is known at every hop.  Routing
+ * control messages add the tag themselves, marked as control, so the MACs
+ * leave them out of the delivery latency.
+ */
+class LrWpanFleeTimestampTag : public Tag
+{
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+
+  LrWpanFleeTimestampTag ();
+
+  /**
+   * \param origin the time the packet entered its first FLEE MAC queue
+   */
+  void SetOrigin (Time origin);
+  /**
+   * \return the time the packet entered its first FLEE MAC queue
+   */
+  Time GetOrigin (void) const;
+  /**
+   * \param enqueue the time the packet entered the queue of this hop
+   */
+  void SetEnqueue (Time enqueue);
+  /**
+   * \return the time the packet entered the queue of this hop
+   */
+  Time GetEnqueue (void) const;
+  /**
+   * \param slotStart the start of the slot in which this hop sends the packet
+   */
+  void SetSlotStart (Time slotStart);
+  /**
+   * \return the start of the slot in which this hop sends the packet
+   */
+  Time GetSlotStart (void) const;
+  /**
+   * \param hops the number of hops the packet made
+   */
+  void SetHops (uint8_t hops);
+  /**
+   * \return the number of hops the packet made
+   */
+  uint8_t GetHops (void) const;
+  /**
+   * \param control true for a routing control message
+   */
+  void SetControl (bool control);
+  /**
+   * \return true for a routing control message
+   */
+  bool IsControl (void) const;
+
+  // inherited from Tag
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+private:
+  int64_t m_origin;     //!< time of the first enqueue in ns
+  int64_t m_enqueue;    //!< time of the enqueue at this hop in ns
+  int64_t m_slotStart;  //!< slot start at this hop in ns
+  uint8_t m_hops;       //!< hops made
+  uint8_t m_control;    //!< 1 for a routing control message
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_FLEE_TIMESTAMP_TAG_H */
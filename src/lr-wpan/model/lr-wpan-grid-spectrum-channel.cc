@@ -0,0 +1,569 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 CTTC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Nicola Baldo <nbaldo@cttc.es>
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-grid-spectrum-channel.h"
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/double.h>
+#include <ns3/uinteger.h>
+#include <ns3/boolean.h>
+#include <ns3/node.h>
+#include <ns3/net-device.h>
+#include <ns3/antenna-model.h>
+#include <ns3/angles.h>
+#include <ns3/spectrum-value.h>
+#include <cmath>
+#include <cstdlib>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LrWpanGridSpectrumChannel");
+
+NS_OBJECT_ENSURE_REGISTERED (LrWpanGridSpectrumChannel);
+
+TypeId
+LrWpanGridSpectrumChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LrWpanGridSpectrumChannel")
+    .SetParent<SpectrumChannel> ()
+    .SetGroupName ("LrWpan")
+    .AddConstructor<LrWpanGridSpectrumChannel> ()
+    .AddAttribute ("CutoffRadius",
+                   "Distance in meters beyond which signals are not delivered. "
+                   "This is also the width of a grid cell, 0 disables the grid.",
+                   DoubleValue (100.0),
+                   MakeDoubleAccessor (&LrWpanGridSpectrumChannel::SetCutoffRadius,
+                                       &LrWpanGridSpectrumChannel::GetCutoffRadius),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("ChannelSpread",
+                   "Number of channels on either side of the transmit channel "
+                   "whose receivers still get the signal.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&LrWpanGridSpectrumChannel::m_channelSpread),
+                   MakeUintegerChecker<uint8_t> ())
+    .AddAttribute ("LinkBudgetCache",
+                   "Compute the loss and delay of every link once and reuse it until "
+                   "a node moves.  Only valid for deterministic loss models.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LrWpanGridSpectrumChannel::m_cacheLinks),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxLossDb",
+                   "If a single-frequency PropagationLossModel is used, this value "
+                   "represents the maximum loss in dB for which transmissions will be "
+                   "passed to the receiving PHY.",
+                   DoubleValue (1.0e9),
+                   MakeDoubleAccessor (&LrWpanGridSpectrumChannel::m_maxLossDb),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("RxSensitivityDbm",
+                   "Received power in dBm below which a cached link is dropped from "
+                   "the row of its transmitter.  Only used with LinkBudgetCache.",
+                   DoubleValue (-106.58),
+                   MakeDoubleAccessor (&LrWpanGridSpectrumChannel::m_rxSensitivityDbm),
+                   MakeDoubleChecker<double> ())
+    .AddTraceSource ("PathLoss",
+                     "This trace is fired whenever a new path loss value "
+                     "is calculated.",
+                     MakeTraceSourceAccessor (&LrWpanGridSpectrumChannel::m_pathLossTrace),
+                     "ns3::SpectrumChannel::LossTracedCallback")
+    .AddTraceSource ("TxSigParams",
+                     "This trace is fired whenever a signal is transmitted.",
+                     MakeTraceSourceAccessor (&LrWpanGridSpectrumChannel::m_txSigParamsTrace),
+                     "ns3::SpectrumChannel::SignalParametersTracedCallback")
+  ;
+  return tid;
+}
+
+LrWpanGridSpectrumChannel::LrWpanGridSpectrumChannel ()
+  : m_gridValid (false),
+    m_cutoffRadius (100.0),
+    m_channelSpread (0),
+    m_cacheLinks (false)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LrWpanGridSpectrumChannel::~LrWpanGridSpectrumChannel ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+LrWpanGridSpectrumChannel::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_phyList.clear ();
+  m_grid.clear ();
+  m_unplaced.clear ();
+  m_phyCell.clear ();
+  m_phyChannel.clear ();
+  m_linkCache.clear ();
+  m_tracked.clear ();
+  m_propagationLoss = 0;
+  m_spectrumPropagationLoss = 0;
+  m_propagationDelay = 0;
+  SpectrumChannel::DoDispose ();
+}
+
+void
+LrWpanGridSpectrumChannel::AddPropagationLossModel (Ptr<PropagationLossModel> loss)
+{
+  NS_LOG_FUNCTION (this << loss);
+  NS_ASSERT (m_propagationLoss == 0);
+  m_propagationLoss = loss;
+}
+
+void
+LrWpanGridSpectrumChannel::AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss)
+{
+  NS_LOG_FUNCTION (this << loss);
+  NS_ASSERT (m_spectrumPropagationLoss == 0);
+  m_spectrumPropagationLoss = loss;
+}
+
+void
+LrWpanGridSpectrumChannel::SetPropagationDelayModel (Ptr<PropagationDelayModel> delay)
+{
+  NS_LOG_FUNCTION (this << delay);
+  NS_ASSERT (m_propagationDelay == 0);
+  m_propagationDelay = delay;
+}
+
+Ptr<SpectrumPropagationLossModel>
+LrWpanGridSpectrumChannel::GetSpectrumPropagationLossModel (void)
+{
+  NS_LOG_FUNCTION (this);
+  return m_spectrumPropagationLoss;
+}
+
+void
+LrWpanGridSpectrumChannel::SetCutoffRadius (double radius)
+{
+  NS_LOG_FUNCTION (this << radius);
+  NS_ASSERT_MSG (radius >= 0, "The cutoff radius can not be negative");
+  m_cutoffRadius = radius;
+  m_gridValid = false;
+  m_linkCache.clear ();
+}
+
+double
+LrWpanGridSpectrumChannel::GetCutoffRadius (void) const
+{
+  return m_cutoffRadius;
+}
+
+void
+LrWpanGridSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
+{
+  NS_LOG_FUNCTION (this << phy);
+  m_phyList.push_back (phy);
+  m_phyChannel[phy] = 0;
+  // the mobility model is usually attached after the PHY joined the
+  // channel, so only bin it when the first signal is sent
+  m_gridValid = false;
+  m_linkCache.clear ();
+}
+
+uint32_t
+LrWpanGridSpectrumChannel::GetNDevices (void) const
+{
+  return m_phyList.size ();
+}
+
+Ptr<NetDevice>
+LrWpanGridSpectrumChannel::GetDevice (uint32_t i) const
+{
+  NS_ASSERT (i < m_phyList.size ());
+  return m_phyList.at (i)->GetDevice ()->GetObject<NetDevice> ();
+}
+
+LrWpanGridSpectrumChannel::CellKey
+LrWpanGridSpectrumChannel::GetCellKey (int32_t x, int32_t y)
+{
+  return (static_cast<int64_t> (x) << 32) | static_cast<uint32_t> (y);
+}
+
+LrWpanGridSpectrumChannel::CellKey
+LrWpanGridSpectrumChannel::GetCell (const Vector &pos) const
+{
+  if (m_cutoffRadius == 0)
+    {
+      return GetCellKey (0, 0);
+    }
+  return GetCellKey (static_cast<int32_t> (std::floor (pos.x / m_cutoffRadius)),
+                     static_cast<int32_t> (std::floor (pos.y / m_cutoffRadius)));
+}
+
+void
+LrWpanGridSpectrumChannel::BuildGrid (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_grid.clear ();
+  m_unplaced.clear ();
+  m_phyCell.clear ();
+  for (PhyList::const_iterator it = m_phyList.begin (); it != m_phyList.end (); ++it)
+    {
+      uint8_t channel = m_phyChannel[*it];
+      Ptr<MobilityModel> mobility = (*it)->GetMobility ();
+      if (mobility == 0)
+        {
+          m_unplaced[channel].push_back (*it);
+          continue;
+        }
+      if (m_tracked.insert (mobility).second)
+        {
+          mobility->TraceConnectWithoutContext ("CourseChange",
+                                                MakeCallback (&LrWpanGridSpectrumChannel::CourseChanged, this));
+        }
+      CellKey cell = GetCell (mobility->GetPosition ());
+      m_grid[cell][channel].push_back (*it);
+      m_phyCell[*it] = cell;
+    }
+  NS_LOG_LOGIC ("binned " << m_phyCell.size () << " PHYs in " << m_grid.size () << " cells");
+  m_gridValid = true;
+}
+
+void
+LrWpanGridSpectrumChannel::CourseChanged (Ptr<const MobilityModel> mobility)
+{
+  NS_LOG_FUNCTION (this << mobility);
+  m_gridValid = false;
+  m_linkCache.clear ();
+}
+
+void
+LrWpanGridSpectrumChannel::NotifyChannelChange (Ptr<SpectrumPhy> phy, uint8_t channelNumber)
+{
+  NS_LOG_FUNCTION (this << phy << (uint32_t)channelNumber);
+  std::map<Ptr<SpectrumPhy>, uint8_t>::iterator current = m_phyChannel.find (phy);
+  NS_ASSERT_MSG (current != m_phyChannel.end (), "PHY is not attached to this channel");
+  if (current->second == channelNumber)
+    {
+      return;
+    }
+  uint8_t previous = current->second;
+  current->second = channelNumber;
+  if (!m_gridValid)
+    {
+      // the index is rebuilt from m_phyChannel anyway
+      return;
+    }
+
+  std::map<Ptr<SpectrumPhy>, CellKey>::const_iterator cell = m_phyCell.find (phy);
+  ChannelIndex &index = (cell == m_phyCell.end ()) ? m_unplaced : m_grid[cell->second];
+  PhyList &from = index[previous];
+  for (PhyList::iterator it = from.begin (); it != from.end (); ++it)
+    {
+      if (*it == phy)
+        {
+          *it = from.back ();
+          from.pop_back ();
+          break;
+        }
+    }
+  index[channelNumber].push_back (phy);
+}
+
+bool
+LrWpanGridSpectrumChannel::IsListening (uint8_t rxChannel, uint8_t txChannel) const
+{
+  if (rxChannel == 0 || txChannel == 0)
+    {
+      return true;
+    }
+  return std::abs (rxChannel - txChannel) <= m_channelSpread;
+}
+
+void
+LrWpanGridSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  NS_LOG_FUNCTION (this << txParams->psd << txParams->duration << txParams->txPhy);
+  NS_ASSERT_MSG (txParams->psd, "NULL txPsd");
+  NS_ASSERT_MSG (txParams->txPhy, "NULL txPhy");
+
+  m_txSigParamsTrace (txParams);
+
+  if (!m_gridValid)
+    {
+      BuildGrid ();
+    }
+
+  uint8_t txChannel = 0;
+  std::map<Ptr<SpectrumPhy>, uint8_t>::const_iterator channel = m_phyChannel.find (txParams->txPhy);
+  if (channel != m_phyChannel.end ())
+    {
+      txChannel = channel->second;
+    }
+
+  Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility ();
+  DeliverToIndex (txParams, senderMobility, m_unplaced, txChannel, false);
+  if (senderMobility == 0)
+    {
+      // no position, so no culling either
+      for (std::map<CellKey, ChannelIndex>::const_iterator cell = m_grid.begin (); cell != m_grid.end (); ++cell)
+        {
+          DeliverToIndex (txParams, senderMobility, cell->second, txChannel, false);
+        }
+      return;
+    }
+
+  if (m_cacheLinks)
+    {
+      // a row only holds the receivers that hear the power it was built for
+      double txPowerDbm = 10.0 * std::log10 (Integral (*txParams->psd)) + 30.0;
+      std::map<Ptr<SpectrumPhy>, LinkRow>::iterator row = m_linkCache.find (txParams->txPhy);
+      if (row == m_linkCache.end () || txPowerDbm > row->second.txPowerDbm)
+        {
+          m_linkCache[txParams->txPhy] = BuildLinkRow (txParams, senderMobility, txPowerDbm);
+          row = m_linkCache.find (txParams->txPhy);
+        }
+      for (std::vector<LinkBudget>::const_iterator link = row->second.links.begin (); link != row->second.links.end (); ++link)
+        {
+          if (IsListening (*link->channel, txChannel))
+            {
+              ScheduleRx (txParams, senderMobility, *link);
+            }
+        }
+      return;
+    }
+
+  if (m_cutoffRadius == 0)
+    {
+      std::map<CellKey, ChannelIndex>::const_iterator cell = m_grid.find (GetCellKey (0, 0));
+      if (cell != m_grid.end ())
+        {
+          DeliverToIndex (txParams, senderMobility, cell->second, txChannel, false);
+        }
+      return;
+    }
+
+  Vector txPos = senderMobility->GetPosition ();
+  int32_t cx = static_cast<int32_t> (std::floor (txPos.x / m_cutoffRadius));
+  int32_t cy = static_cast<int32_t> (std::floor (txPos.y / m_cutoffRadius));
+  for (int32_t x = cx - 1; x <= cx + 1; x++)
+    {
+      for (int32_t y = cy - 1; y <= cy + 1; y++)
+        {
+          std::map<CellKey, ChannelIndex>::const_iterator cell = m_grid.find (GetCellKey (x, y));
+          if (cell != m_grid.end ())
+            {
+              DeliverToIndex (txParams, senderMobility, cell->second, txChannel, true);
+            }
+        }
+    }
+}
+
+void
+LrWpanGridSpectrumChannel::GetNearbyPhys (Ptr<MobilityModel> senderMobility, PhyList &receivers) const
+{
+  std::vector<CellKey> cells;
+  if (m_cutoffRadius == 0)
+    {
+      cells.push_back (GetCellKey (0, 0));
+    }
+  else
+    {
+      Vector txPos = senderMobility->GetPosition ();
+      int32_t cx = static_cast<int32_t> (std::floor (txPos.x / m_cutoffRadius));
+      int32_t cy = static_cast<int32_t> (std::floor (txPos.y / m_cutoffRadius));
+      for (int32_t x = cx - 1; x <= cx + 1; x++)
+        {
+          for (int32_t y = cy - 1; y <= cy + 1; y++)
+            {
+              cells.push_back (GetCellKey (x, y));
+            }
+        }
+    }
+
+  for (std::vector<CellKey>::const_iterator key = cells.begin (); key != cells.end (); ++key)
+    {
+      std::map<CellKey, ChannelIndex>::const_iterator cell = m_grid.find (*key);
+      if (cell == m_grid.end ())
+        {
+          continue;
+        }
+      for (ChannelIndex::const_iterator channel = cell->second.begin (); channel != cell->second.end (); ++channel)
+        {
+          for (PhyList::const_iterator it = channel->second.begin (); it != channel->second.end (); ++it)
+            {
+              if (m_cutoffRadius == 0 || senderMobility->GetDistanceFrom ((*it)->GetMobility ()) <= m_cutoffRadius)
+                {
+                  receivers.push_back (*it);
+                }
+            }
+        }
+    }
+}
+
+LrWpanGridSpectrumChannel::LinkRow
+LrWpanGridSpectrumChannel::BuildLinkRow (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                         double txPowerDbm)
+{
+  NS_LOG_FUNCTION (this << txParams->txPhy << txPowerDbm);
+  PhyList receivers;
+  GetNearbyPhys (senderMobility, receivers);
+
+  LinkRow row;
+  row.txPowerDbm = txPowerDbm;
+  double minGain = std::pow (10.0, (m_rxSensitivityDbm - txPowerDbm) / 10.0);
+  for (PhyList::const_iterator it = receivers.begin (); it != receivers.end (); ++it)
+    {
+      LinkBudget link;
+      if (*it != txParams->txPhy && CalcLinkBudget (txParams, senderMobility, *it, link)
+          && (link.mobility == 0 || link.gain >= minGain))
+        {
+          row.links.push_back (link);
+        }
+    }
+  NS_LOG_LOGIC ("cached " << row.links.size () << " of " << receivers.size () << " links");
+  return row;
+}
+
+void
+LrWpanGridSpectrumChannel::DeliverToIndex (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                           const ChannelIndex &index, uint8_t txChannel, bool checkDistance)
+{
+  ChannelIndex::const_iterator first = index.begin ();
+  uint16_t last = 0xff;
+  if (txChannel != 0)
+    {
+      // receivers of which the channel is unknown hear everything
+      ChannelIndex::const_iterator unknown = index.find (0);
+      if (unknown != index.end ())
+        {
+          DeliverToList (txParams, senderMobility, unknown->second, checkDistance);
+        }
+      first = index.lower_bound (txChannel > m_channelSpread ? txChannel - m_channelSpread : 1);
+      last = txChannel + m_channelSpread;
+    }
+
+  for (ChannelIndex::const_iterator channel = first; channel != index.end () && channel->first <= last; ++channel)
+    {
+      DeliverToList (txParams, senderMobility, channel->second, checkDistance);
+    }
+}
+
+void
+LrWpanGridSpectrumChannel::DeliverToList (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                          const PhyList &receivers, bool checkDistance)
+{
+  for (PhyList::const_iterator it = receivers.begin (); it != receivers.end (); ++it)
+    {
+      if (*it == txParams->txPhy)
+        {
+          continue;
+        }
+      if (checkDistance && senderMobility->GetDistanceFrom ((*it)->GetMobility ()) > m_cutoffRadius)
+        {
+          continue;
+        }
+      LinkBudget link;
+      if (CalcLinkBudget (txParams, senderMobility, *it, link))
+        {
+          ScheduleRx (txParams, senderMobility, link);
+        }
+    }
+}
+
+bool
+LrWpanGridSpectrumChannel::CalcLinkBudget (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                           Ptr<SpectrumPhy> receiver, LinkBudget &link)
+{
+  link.receiver = receiver;
+  link.mobility = receiver->GetMobility ();
+  link.channel = &m_phyChannel[receiver];
+  link.gain = 1.0;
+  link.delay = MicroSeconds (0);
+
+  if (senderMobility == 0 || link.mobility == 0)
+    {
+      return true;
+    }
+
+  double pathLossDb = 0;
+  if (txParams->txAntenna != 0)
+    {
+      Angles txAngles (link.mobility->GetPosition (), senderMobility->GetPosition ());
+      pathLossDb -= txParams->txAntenna->GetGainDb (txAngles);
+    }
+  Ptr<AntennaModel> rxAntenna = receiver->GetRxAntenna ();
+  if (rxAntenna != 0)
+    {
+      Angles rxAngles (senderMobility->GetPosition (), link.mobility->GetPosition ());
+      pathLossDb -= rxAntenna->GetGainDb (rxAngles);
+    }
+  if (m_propagationLoss)
+    {
+      pathLossDb -= m_propagationLoss->CalcRxPower (0, senderMobility, link.mobility);
+    }
+  NS_LOG_LOGIC ("total pathLoss = " << pathLossDb << " dB");
+  m_pathLossTrace (txParams->txPhy, receiver, pathLossDb);
+  if (pathLossDb > m_maxLossDb)
+    {
+      // beyond range
+      return false;
+    }
+  link.gain = std::pow (10.0, (-pathLossDb) / 10.0);
+
+  if (m_propagationDelay)
+    {
+      link.delay = m_propagationDelay->GetDelay (senderMobility, link.mobility);
+    }
+  return true;
+}
+
+void
+LrWpanGridSpectrumChannel::ScheduleRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                                       const LinkBudget &link)
+{
+  NS_LOG_LOGIC ("copying signal parameters " << txParams);
+  Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
+  if (senderMobility && link.mobility)
+    {
+      *(rxParams->psd) *= link.gain;
+      if (m_spectrumPropagationLoss)
+        {
+          rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity (rxParams->psd, senderMobility, link.mobility);
+        }
+    }
+
+  Ptr<NetDevice> netDev = link.receiver->GetDevice ();
+  if (netDev)
+    {
+      // the receiver has a NetDevice, so we expect that it is attached to a Node
+      uint32_t dstNode = netDev->GetNode ()->GetId ();
+      Simulator::ScheduleWithContext (dstNode, link.delay, &LrWpanGridSpectrumChannel::StartRx, this,
+                                      rxParams, link.receiver);
+    }
+  else
+    {
+      Simulator::Schedule (link.delay, &LrWpanGridSpectrumChannel::StartRx, this,
+                           rxParams, link.receiver);
+    }
+}
+
+void
+LrWpanGridSpectrumChannel::StartRx (Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver)
+{
+  NS_LOG_FUNCTION (this << params);
+  receiver->StartRx (params);
+}
+
+} // namespace ns3
@@ -0,0 +1,273 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2009 CTTC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Nicola Baldo <nbaldo@cttc.es>
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_GRID_SPECTRUM_CHANNEL_H
+#define LR_WPAN_GRID_SPECTRUM_CHANNEL_H
+
+#include <ns3/spectrum-channel.h>
+#include <ns3/spectrum-phy.h>
+#include <ns3/spectrum-signal-parameters.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/spectrum-propagation-loss-model.h>
+#include <ns3/mobility-model.h>
+#include <ns3/traced-callback.h>
+#include <vector>
+#include <map>
+#include <set>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief SpectrumChannel that only delivers signals to nearby PHYs
+ *
+ * All LR-WPAN PHYs share a single SpectrumModel, so this channel behaves
+ * like a SingleModelSpectrumChannel.  The PHYs are however binned into a
+ * uniform 2D grid whose cells are CutoffRadius wide.  A transmission is only
+ * evaluated for the PHYs in the cell of the transmitter and its eight
+ * neighbouring cells, and dropped for receivers further away than
+ * CutoffRadius.  Choose the radius as the distance at which the received
+ * power falls below the receiver sensitivity; the per-transmission cost then
+ * scales with the node density instead of the number of nodes.
+ *
+ * The grid is built lazily at the first transmission and rebuilt whenever a
+ * mobility model of one of the attached PHYs fires its CourseChange trace.
+ * PHYs without a mobility model always receive, as they would on the
+ * default channels.  A CutoffRadius of 0 disables the spatial culling.
+ *
+ * Within a cell, PHYs are further indexed by the IEEE 802.15.4 channel they
+ * listen on, as reported through NotifyChannelChange ().  A signal is only
+ * handed to PHYs on the channel of the transmitter, or up to ChannelSpread
+ * channels next to it.  PHYs that never reported a channel receive every
+ * signal.  A PHY that switches to a channel while a signal is already in
+ * the air on it will not see that signal, not even as interference.
+ *
+ * When LinkBudgetCache is enabled, the antenna gains, path loss and
+ * propagation delay of every link within the cutoff radius are computed once
+ * per transmitter and kept in a sparse row holding only the receivers at
+ * which the transmit power arrives above RxSensitivityDbm.  Such a row is
+ * rebuilt when the transmitter raises its power.  Every row is dropped when
+ * a mobility model fires CourseChange or a PHY is added, so static
+ * topologies pay the log10 and distance math only once per link.  The cache
+ * is disabled by default, as it freezes the gains of random propagation
+ * loss models; LrWpanHelper::EnableSpatialGrid enables it.
+ */
+class LrWpanGridSpectrumChannel : public SpectrumChannel
+{
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  LrWpanGridSpectrumChannel ();
+  virtual ~LrWpanGridSpectrumChannel ();
+
+  // inherited from SpectrumChannel
+  virtual void AddPropagationLossModel (Ptr<PropagationLossModel> loss);
+  virtual void AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss);
+  virtual void SetPropagationDelayModel (Ptr<PropagationDelayModel> delay);
+  virtual Ptr<SpectrumPropagationLossModel> GetSpectrumPropagationLossModel (void);
+  virtual void AddRx (Ptr<SpectrumPhy> phy);
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+
+  // inherited from Channel
+  virtual uint32_t GetNDevices (void) const;
+  virtual Ptr<NetDevice> GetDevice (uint32_t i) const;
+
+  /**
+   * \brief Set the radius beyond which no signal is delivered.
+   * \param radius the cutoff radius in meters
+   */
+  void SetCutoffRadius (double radius);
+
+  /**
+   * \return the cutoff radius in meters
+   */
+  double GetCutoffRadius (void) const;
+
+  /**
+   * \brief Move a PHY to the receiver set of another channel.
+   * \param phy the PHY that switched channel
+   * \param channelNumber the new phyCurrentChannel (11-26)
+   */
+  void NotifyChannelChange (Ptr<SpectrumPhy> phy, uint8_t channelNumber);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  /// key of a grid cell, both cell indices packed in one integer
+  typedef int64_t CellKey;
+  /// list of PHYs
+  typedef std::vector<Ptr<SpectrumPhy> > PhyList;
+  /// PHYs indexed on the channel they listen on, 0 if unknown
+  typedef std::map<uint8_t, PhyList> ChannelIndex;
+
+  /**
+   * \brief Get the key of the cell with the given indices.
+   * \param x cell index along the x axis
+   * \param y cell index along the y axis
+   * \return the key
+   */
+  static CellKey GetCellKey (int32_t x, int32_t y);
+
+  /**
+   * \brief Bin all PHYs with a mobility model into the grid.
+   */
+  void BuildGrid (void);
+
+  /**
+   * \brief Mark the grid invalid after a position change.
+   * \param mobility the mobility model that moved
+   */
+  void CourseChanged (Ptr<const MobilityModel> mobility);
+
+  /**
+   * \brief Get the cell a position belongs to.
+   * \param pos the position
+   * \return the key of the cell
+   */
+  CellKey GetCell (const Vector &pos) const;
+
+  /**
+   * \brief Precomputed propagation of a signal from a transmitter to a receiver.
+   */
+  struct LinkBudget
+  {
+    Ptr<SpectrumPhy> receiver;       //!< the receiving PHY
+    Ptr<MobilityModel> mobility;     //!< the mobility of the receiver, 0 if unplaced
+    const uint8_t *channel;          //!< the channel the receiver listens on
+    double gain;                     //!< linear gain of antennas and path loss
+    Time delay;                      //!< propagation delay
+  };
+  /// receivers above the sensitivity threshold of one transmitter
+  struct LinkRow
+  {
+    double txPowerDbm;               //!< transmit power the row was pruned for
+    std::vector<LinkBudget> links;   //!< the receivers that hear that power
+  };
+
+  /**
+   * \brief Check if a receiver hears a transmit channel.
+   * \param rxChannel the channel of the receiver, 0 if unknown
+   * \param txChannel the channel of the transmitter, 0 if unknown
+   * \return true if the signal overlaps the receive channel
+   */
+  bool IsListening (uint8_t rxChannel, uint8_t txChannel) const;
+
+  /**
+   * \brief Get the PHYs with a position within the cutoff radius.
+   * \param senderMobility the mobility of the transmitter
+   * \param receivers list to which the receivers are appended
+   */
+  void GetNearbyPhys (Ptr<MobilityModel> senderMobility, PhyList &receivers) const;
+
+  /**
+   * \brief Compute the sparse row of link budgets of a transmitter.
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility of the transmitter
+   * \param txPowerDbm the total transmit power of the signal
+   * \return the receivers for which the loss does not exceed MaxLossDb and
+   * the received power is at least RxSensitivityDbm
+   */
+  LinkRow BuildLinkRow (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                        double txPowerDbm);
+
+  /**
+   * \brief Compute the propagation from a transmitter to a receiver.
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility of the transmitter (may be 0)
+   * \param receiver the receiving PHY
+   * \param link filled with the link budget
+   * \return false if the loss exceeds MaxLossDb
+   */
+  bool CalcLinkBudget (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                       Ptr<SpectrumPhy> receiver, LinkBudget &link);
+
+  /**
+   * \brief Schedule the reception of a signal over a computed link.
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility of the transmitter (may be 0)
+   * \param link the link budget
+   */
+  void ScheduleRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                   const LinkBudget &link);
+
+  /**
+   * \brief Deliver a signal to the PHYs of a cell that listen on a matching channel.
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility of the transmitter
+   * \param index the receivers of the cell
+   * \param txChannel the channel of the transmitter, 0 if unknown
+   * \param checkDistance drop receivers beyond the cutoff radius
+   */
+  void DeliverToIndex (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                       const ChannelIndex &index, uint8_t txChannel, bool checkDistance);
+
+  /**
+   * \brief Deliver a signal to a list of receivers.
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility of the transmitter
+   * \param receivers the receivers
+   * \param checkDistance drop receivers beyond the cutoff radius
+   */
+  void DeliverToList (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility,
+                      const PhyList &receivers, bool checkDistance);
+
+  /**
+   * \brief Pass a signal to a receiver once the propagation delay passed.
+   * \param params the parameters of the received signal
+   * \param receiver the receiving PHY
+   */
+  void StartRx (Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver);
+
+  PhyList m_phyList;                               //!< all attached PHYs
+  std::map<CellKey, ChannelIndex> m_grid;          //!< PHYs with a position, per cell
+  ChannelIndex m_unplaced;                         //!< PHYs without mobility model
+  std::map<Ptr<SpectrumPhy>, CellKey> m_phyCell;   //!< cell of every PHY in the grid
+  std::map<Ptr<SpectrumPhy>, uint8_t> m_phyChannel; //!< channel every PHY listens on
+  std::set<Ptr<MobilityModel> > m_tracked;         //!< mobility models we listen to
+  bool m_gridValid;                                //!< false if the grid must be rebuilt
+  double m_cutoffRadius;                           //!< cell size and cutoff radius in meters
+  uint8_t m_channelSpread;                         //!< neighbouring channels that still receive
+  bool m_cacheLinks;                               //!< true if link budgets are cached
+  std::map<Ptr<SpectrumPhy>, LinkRow> m_linkCache; //!< link budgets per transmitter
+
+  Ptr<PropagationLossModel> m_propagationLoss;                  //!< single-frequency loss model
+  Ptr<SpectrumPropagationLossModel> m_spectrumPropagationLoss;  //!< frequency-dependent loss model
+  Ptr<PropagationDelayModel> m_propagationDelay;                //!< propagation delay model
+  double m_maxLossDb;                                           //!< loss above which signals are dropped
+  double m_rxSensitivityDbm;                                    //!< power below which cached links are dropped
+
+  /// traced callback for the path loss of every evaluated link
+  TracedCallback<Ptr<SpectrumPhy>, Ptr<SpectrumPhy>, double > m_pathLossTrace;
+  /// traced callback for the signal parameters of every transmission
+  TracedCallback<Ptr<SpectrumSignalParameters> > m_txSigParamsTrace;
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_GRID_SPECTRUM_CHANNEL_H */
@@ -0,0 +1,215 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-lazy-energy-source.h"
+#include <ns3/log.h>
+#include <ns3/assert.h>
+#include <ns3/double.h>
+#include <ns3/boolean.h>
+#include <ns3/trace-source-accessor.h>
+#include <ns3/simulator.h>
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LrWpanLazyEnergySource");
+
+NS_OBJECT_ENSURE_REGISTERED (LrWpanLazyEnergySource);
+
+TypeId
+LrWpanLazyEnergySource::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LrWpanLazyEnergySource")
+    .SetParent<EnergySource> ()
+    .SetGroupName ("LrWpan")
+    .AddConstructor<LrWpanLazyEnergySource> ()
+    .AddAttribute ("LrWpanEnergySourceInitialEnergyJ",
+                   "Initial energy stored in the energy source.",
+                   DoubleValue (10),
+                   MakeDoubleAccessor (&LrWpanLazyEnergySource::SetInitialEnergy,
+                                       &LrWpanLazyEnergySource::GetInitialEnergy),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("LrWpanEnergySupplyVoltageV",
+                   "Supply voltage of the energy source.",
+                   DoubleValue (3.0),
+                   MakeDoubleAccessor (&LrWpanLazyEnergySource::SetSupplyVoltage,
+                                       &LrWpanLazyEnergySource::GetSupplyVoltage),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("LrWpanUnlimitedEnergy",
+                   "Keep counting the energy that is used, but never run out. "
+                   "The remaining energy can then become negative.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LrWpanLazyEnergySource::m_unlimited),
+                   MakeBooleanChecker ())
+    .AddTraceSource ("RemainingEnergy",
+                     "Remaining energy at the energy source, at every update.",
+                     MakeTraceSourceAccessor (&LrWpanLazyEnergySource::m_remainingEnergyJ),
+                     "ns3::TracedValueCallback::Double")
+  ;
+  return tid;
+}
+
+LrWpanLazyEnergySource::LrWpanLazyEnergySource ()
+  : m_initialEnergyJ (0),
+    m_supplyVoltageV (0),
+    m_unlimited (false),
+    m_depleted (false),
+    m_remainingEnergyJ (0),
+    m_lastUpdateTime (Seconds (0))
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LrWpanLazyEnergySource::~LrWpanLazyEnergySource ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+LrWpanLazyEnergySource::SetInitialEnergy (double initialEnergyJ)
+{
+  NS_LOG_FUNCTION (this << initialEnergyJ);
+  NS_ASSERT (initialEnergyJ >= 0);
+  m_initialEnergyJ = initialEnergyJ;
+  m_remainingEnergyJ = initialEnergyJ;
+}
+
+void
+LrWpanLazyEnergySource::SetSupplyVoltage (double supplyVoltageV)
+{
+  NS_LOG_FUNCTION (this << supplyVoltageV);
+  m_supplyVoltageV = supplyVoltageV;
+}
+
+double
+LrWpanLazyEnergySource::GetInitialEnergy (void) const
+{
+  return m_initialEnergyJ;
+}
+
+double
+LrWpanLazyEnergySource::GetSupplyVoltage (void) const
+{
+  return m_supplyVoltageV;
+}
+
+double
+LrWpanLazyEnergySource::GetRemainingEnergy (void)
+{
+  NS_LOG_FUNCTION (this);
+  CalculateRemainingEnergy ();
+  return m_remainingEnergyJ;
+}
+
+double
+LrWpanLazyEnergySource::GetEnergyFraction (void)
+{
+  NS_LOG_FUNCTION (this);
+  CalculateRemainingEnergy ();
+  return (m_initialEnergyJ > 0) ? m_remainingEnergyJ / m_initialEnergyJ : 0;
+}
+
+void
+LrWpanLazyEnergySource::UpdateEnergySource (void)
+{
+  NS_LOG_FUNCTION (this);
+  // the device models call this before they change state, so the energy
+  // since the last update is drawn at the current they report now
+  if (m_depleted)
+    {
+      return;
+    }
+  CheckDepletion ();
+}
+
+void
+LrWpanLazyEnergySource::DoInitialize (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_lastUpdateTime = Simulator::Now ();
+  UpdateEnergySource ();
+}
+
+void
+LrWpanLazyEnergySource::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  // keep the energy up to the end of the simulation readable afterwards
+  CalculateRemainingEnergy ();
+  m_depletionEvent.Cancel ();
+  BreakDeviceEnergyModelRefCycle ();
+}
+
+void
+LrWpanLazyEnergySource::CalculateRemainingEnergy (void)
+{
+  Time duration = Simulator::Now () - m_lastUpdateTime;
+  if (!duration.IsStrictlyPositive ())
+    {
+      return;
+    }
+  m_lastUpdateTime = Simulator::Now ();
+  double energyJ = CalculateTotalCurrent () * m_supplyVoltageV * duration.GetSeconds ();
+  if (m_unlimited)
+    {
+      m_remainingEnergyJ -= energyJ;
+    }
+  else
+    {
+      m_remainingEnergyJ = std::max (0.0, m_remainingEnergyJ - energyJ);
+    }
+}
+
+void
+LrWpanLazyEnergySource::ScheduleDepletion (void)
+{
+  double powerW = CalculateTotalCurrent () * m_supplyVoltageV;
+  if (m_unlimited || powerW <= 0)
+    {
+      return;
+    }
+  // one time step late, so the energy is surely gone when it fires
+  Time delay = Seconds (m_remainingEnergyJ / powerW) + TimeStep (1);
+  if (m_depletionEvent.IsRunning () && Simulator::GetDelayLeft (m_depletionEvent) <= delay)
+    {
+      return;
+    }
+  m_depletionEvent.Cancel ();
+  m_depletionEvent = Simulator::Schedule (delay, &LrWpanLazyEnergySource::CheckDepletion, this);
+}
+
+void
+LrWpanLazyEnergySource::CheckDepletion (void)
+{
+  NS_LOG_FUNCTION (this);
+  CalculateRemainingEnergy ();
+  if (!m_unlimited && m_remainingEnergyJ <= 0)
+    {
+      NS_LOG_DEBUG ("Energy depleted at " << Simulator::Now ().GetSeconds () << " s");
+      m_depleted = true;
+      m_depletionEvent.Cancel ();
+      NotifyEnergyDrained ();
+      return;
+    }
+  // the draw went down since the event was scheduled, or it went up
+  ScheduleDepletion ();
+}
+
+} // namespace ns3
@@ -0,0 +1,111 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_LAZY_ENERGY_SOURCE_H
+#define LR_WPAN_LAZY_ENERGY_SOURCE_H
+
+#include <ns3/energy-source.h>
+#include <ns3/traced-value.h>
+#include <ns3/event-id.h>
+#include <ns3/nstime.h>
+
+namespace ns3 {
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Energy source that only integrates the current when asked to
+ *
+ * The energy sources of the energy framework update the remaining energy
+ * every PeriodicEnergyUpdateInterval, which costs every node one event per
+ * interval even when its radio does not change state for a whole FLEE
+ * cycle.  The current drawn by the device energy models only changes when
+ * they call UpdateEnergySource () on a state transition, so this source
+ * integrates the total current over the time since the last update at
+ * every transition, and when GetRemainingEnergy () is called.  The result
+ * is the same as with periodic updates, without the periodic events.
+ *
+ * The only event this source schedules is the one at the moment the energy
+ * would run out at the current draw.  It is moved forward when the draw
+ * goes up, and checked again when it fires after the draw went down.  The
+ * RemainingEnergy trace only fires at the updates.
+ */
+class LrWpanLazyEnergySource : public EnergySource
+{
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  LrWpanLazyEnergySource ();
+  virtual ~LrWpanLazyEnergySource ();
+
+  // inherited from EnergySource
+  virtual double GetInitialEnergy (void) const;
+  virtual double GetSupplyVoltage (void) const;
+  virtual double GetRemainingEnergy (void);
+  virtual double GetEnergyFraction (void);
+  virtual void UpdateEnergySource (void);
+
+  /**
+   * \param initialEnergyJ the initial energy in J
+   */
+  void SetInitialEnergy (double initialEnergyJ);
+
+  /**
+   * \param supplyVoltageV the supply voltage in V
+   */
+  void SetSupplyVoltage (double supplyVoltageV);
+
+private:
+  // inherited from Object
+  virtual void DoInitialize (void);
+  virtual void DoDispose (void);
+
+  /**
+   * Subtract the energy drawn since the last update.
+   */
+  void CalculateRemainingEnergy (void);
+
+  /**
+   * Schedule the depletion event at the time the energy runs out at the
+   * current draw, if that is earlier than the scheduled one.
+   */
+  void ScheduleDepletion (void);
+
+  /**
+   * Called at the predicted depletion time.
+   */
+  void CheckDepletion (void);
+
+  double m_initialEnergyJ;                 //!< initial energy in J
+  double m_supplyVoltageV;                 //!< supply voltage in V
+  bool m_unlimited;                        //!< true if the energy never runs out
+  bool m_depleted;                         //!< true once the models were told
+  TracedValue<double> m_remainingEnergyJ;  //!< remaining energy in J
+  Time m_lastUpdateTime;                   //!< time of the last integration
+  EventId m_depletionEvent;                //!< predicted depletion
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_LAZY_ENERGY_SOURCE_H */
@@ -0,0 +1,210 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#include "lr-wpan-traffic-source.h"
+#include <ns3/lr-wpan-net-device.h>
+#include <ns3/lr-wpan-phy.h>
+#include <ns3/log.h>
+#include <ns3/enum.h>
+#include <ns3/uinteger.h>
+#include <ns3/double.h>
+#include <ns3/packet.h>
+#include <ns3/simulator.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LrWpanTrafficSource");
+
+NS_OBJECT_ENSURE_REGISTERED (LrWpanTrafficSource);
+
+TypeId
+LrWpanTrafficSource::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LrWpanTrafficSource")
+    .SetParent<Object> ()
+    .SetGroupName ("LrWpan")
+    .AddConstructor<LrWpanTrafficSource> ()
+    .AddAttribute ("Mode",
+                   "The arrival process of the packets.",
+                   EnumValue (LrWpanTrafficSource::PERIODIC),
+                   MakeEnumAccessor (&LrWpanTrafficSource::m_mode),
+                   MakeEnumChecker (LrWpanTrafficSource::PERIODIC, "Periodic",
+                                    LrWpanTrafficSource::POISSON, "Poisson",
+                                    LrWpanTrafficSource::ON_OFF, "OnOff"))
+    .AddAttribute ("Interval",
+                   "The (mean) time between two packets.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&LrWpanTrafficSource::m_interval),
+                   MakeTimeChecker ())
+    .AddAttribute ("OnTime",
+                   "The mean length of an ON period in OnOff mode.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&LrWpanTrafficSource::m_onTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("OffTime",
+                   "The mean length of an OFF period in OnOff mode.",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&LrWpanTrafficSource::m_offTime),
+                   MakeTimeChecker ())
+    .AddAttribute ("PacketSize",
+                   "The size of the packets in bytes.",
+                   UintegerValue (90),
+                   MakeUintegerAccessor (&LrWpanTrafficSource::m_packetSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("BlockSize",
+                   "The number of gaps drawn at once in Poisson mode.",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&LrWpanTrafficSource::m_blockSize),
+                   MakeUintegerChecker<uint32_t> (1))
+  ;
+  return tid;
+}
+
+LrWpanTrafficSource::LrWpanTrafficSource ()
+  : m_nextGap (0),
+    m_sent (0)
+{
+  NS_LOG_FUNCTION (this);
+  m_gapVar = CreateObject<ExponentialRandomVariable> ();
+  m_periodVar = CreateObject<ExponentialRandomVariable> ();
+}
+
+LrWpanTrafficSource::~LrWpanTrafficSource ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+LrWpanTrafficSource::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_event.Cancel ();
+  m_device = 0;
+  m_phy = 0;
+  Object::DoDispose ();
+}
+
+void
+LrWpanTrafficSource::SetDevice (Ptr<NetDevice> device, Address destination)
+{
+  NS_LOG_FUNCTION (this << device << destination);
+  m_device = device;
+  m_destination = destination;
+  Ptr<LrWpanNetDevice> lrwpan = device->GetObject<LrWpanNetDevice> ();
+  m_phy = lrwpan ? lrwpan->GetPhy () : 0;
+}
+
+void
+LrWpanTrafficSource::Start (Time start, Time duration)
+{
+  NS_LOG_FUNCTION (this << start << duration);
+  NS_ASSERT_MSG (m_device, "Set the device before starting the traffic source");
+  NS_ASSERT (m_interval.IsStrictlyPositive ());
+  m_event.Cancel ();
+  m_end = Simulator::Now () + start + duration;
+  // draw a new block with the current mean
+  m_gapVar->SetAttribute ("Mean", DoubleValue (m_interval.GetSeconds ()));
+  m_gaps.clear ();
+  m_nextGap = 0;
+  m_onUntil = Simulator::Now () + start;
+  if (m_mode == ON_OFF)
+    {
+      m_onUntil += Seconds (m_periodVar->GetValue (m_onTime.GetSeconds (), 0));
+    }
+  m_event = Simulator::Schedule (start, &LrWpanTrafficSource::Send, Ptr<LrWpanTrafficSource> (this));
+}
+
+void
+LrWpanTrafficSource::Stop (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_event.Cancel ();
+}
+
+uint64_t
+LrWpanTrafficSource::GetSentPackets (void) const
+{
+  return m_sent;
+}
+
+int64_t
+LrWpanTrafficSource::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_gapVar->SetStream (stream);
+  m_periodVar->SetStream (stream + 1);
+  return 2;
+}
+
+void
+LrWpanTrafficSource::Send (void)
+{
+  // a node that ran out of energy stays silent
+  if (m_phy && m_phy->GetStatus () == IEEE_802_15_4_PHY_FORCE_TRX_OFF)
+    {
+      NS_LOG_LOGIC ("PHY is off, stopping");
+      return;
+    }
+  m_device->Send (Create<Packet> (m_packetSize), m_destination, 0x86DD);
+  m_sent++;
+  ScheduleNext ();
+}
+
+void
+LrWpanTrafficSource::ScheduleNext (void)
+{
+  Time next = Simulator::Now () + NextGap ();
+  if (m_mode == ON_OFF)
+    {
+      // skip the OFF periods, an ON period can be shorter than a gap
+      while (next >= m_onUntil && m_onUntil <= m_end)
+        {
+          Time on = m_onUntil + Seconds (m_periodVar->GetValue (m_offTime.GetSeconds (), 0));
+          m_onUntil = on + Seconds (m_periodVar->GetValue (m_onTime.GetSeconds (), 0));
+          next = on;
+        }
+    }
+  if (next > m_end)
+    {
+      return;
+    }
+  m_event = Simulator::Schedule (next - Simulator::Now (), &LrWpanTrafficSource::Send, Ptr<LrWpanTrafficSource> (this));
+}
+
+Time
+LrWpanTrafficSource::NextGap (void)
+{
+  if (m_mode != POISSON)
+    {
+      return m_interval;
+    }
+  if (m_nextGap == m_gaps.size ())
+    {
+      m_gaps.resize (m_blockSize);
+      for (uint32_t i = 0; i < m_blockSize; i++)
+        {
+          m_gaps[i] = m_gapVar->GetValue ();
+        }
+      m_nextGap = 0;
+    }
+  return Seconds (m_gaps[m_nextGap++]);
+}
+
+} // namespace ns3
@@ -0,0 +1,145 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2011 The Boeing Company
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Authors:
+ *  Brecht Reynders <brecht.reynders@esat.kuleuven.be>
+ */
+#ifndef LR_WPAN_TRAFFIC_SOURCE_H
+#define LR_WPAN_TRAFFIC_SOURCE_H
+
+#include <ns3/object.h>
+#include <ns3/net-device.h>
+#include <ns3/address.h>
+#include <ns3/nstime.h>
+#include <ns3/event-id.h>
+#include <ns3/random-variable-stream.h>
+#include <vector>
+
+namespace ns3 {
+
+class LrWpanPhy;
+
+/**
+ * \ingroup lr-wpan
+ *
+ * \brief Sends packets of a fixed size straight to a net device
+ *
+ * The source has at most one pending event: the next packet.  In Periodic
+ * mode the packets are Interval apart.  In Poisson mode the time between two
+ * packets is exponentially distributed with mean Interval; the gaps are
+ * drawn BlockSize at a time.  In OnOff mode the packets are Interval apart
+ * during ON periods and the source is silent during OFF periods, both
+ * exponentially distributed with mean OnTime and OffTime.
+ *
+ * The device and its PHY are looked up once in SetDevice ().  The source
+ * stops for good when the PHY is forced off, e.g. because its energy
+ * source is depleted.  A pending event holds a reference to the source, so
+ * it stays alive until it is stopped or its last packet is sent.
+ */
+class LrWpanTrafficSource : public Object
+{
+public:
+  /// the arrival process of the packets
+  enum ArrivalMode
+  {
+    PERIODIC,
+    POISSON,
+    ON_OFF
+  };
+
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  LrWpanTrafficSource ();
+  virtual ~LrWpanTrafficSource ();
+
+  /**
+   * \param device the device to send on
+   * \param destination the destination of the packets
+   */
+  void SetDevice (Ptr<NetDevice> device, Address destination);
+
+  /**
+   * \brief Send packets during an interval.
+   * \param start the delay until the first packet
+   * \param duration the time after the start at which the last packet can be sent
+   */
+  void Start (Time start, Time duration);
+
+  /**
+   * \brief Cancel the next packet.
+   */
+  void Stop (void);
+
+  /**
+   * \return the number of packets sent
+   */
+  uint64_t GetSentPackets (void) const;
+
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by this source.
+   *
+   * \param stream first stream index to use
+   * \return the number of stream indices assigned by this source
+   */
+  int64_t AssignStreams (int64_t stream);
+
+private:
+  // inherited from Object
+  virtual void DoDispose (void);
+
+  /**
+   * Send a packet and schedule the next one.
+   */
+  void Send (void);
+
+  /**
+   * Schedule the packet after the one of now.
+   */
+  void ScheduleNext (void);
+
+  /**
+   * \return the time to the next packet, the next of the drawn gaps in Poisson mode
+   */
+  Time NextGap (void);
+
+  ArrivalMode m_mode;                          //!< arrival process
+  Time m_interval;                             //!< (mean) time between two packets
+  Time m_onTime;                               //!< mean length of an ON period
+  Time m_offTime;                              //!< mean length of an OFF period
+  uint32_t m_packetSize;                       //!< size of the packets
+  uint32_t m_blockSize;                        //!< gaps drawn at once
+  Ptr<NetDevice> m_device;                     //!< device to send on
+  Ptr<LrWpanPhy> m_phy;                        //!< PHY of the device, if any
+  Address m_destination;                       //!< destination of the packets
+  Time m_end;                                  //!< time after which no packet is sent
+  Time m_onUntil;                              //!< end of the current ON period
+  std::vector<double> m_gaps;                  //!< drawn gaps in seconds
+  uint32_t m_nextGap;                          //!< next unused gap in m_gaps
+  Ptr<ExponentialRandomVariable> m_gapVar;     //!< gaps in Poisson mode
+  Ptr<ExponentialRandomVariable> m_periodVar;  //!< ON and OFF periods
+  EventId m_event;                             //!< the next packet
+  uint64_t m_sent;                             //!< packets sent
+};
+
+} // namespace ns3
+
+#endif /* LR_WPAN_TRAFFIC_SOURCE_H */